@@ -1,6 +1,8 @@
 #include "FunctionRewriting.h"
 #include "SemanticUtil.h"
 
+#include "clang/AST/ExprCXX.h"
+
 #include <string>
 
 using namespace clang;
@@ -42,10 +44,41 @@ bool FunctionUnique::Analyser::VisitCallExpr(clang::CallExpr* CE) {
         if (fileName.find(metadata.baseDirectory) == std::string::npos)
             return true;
 
+        // Every translation unit calling the function has to be rewritten.
+        candidates.addTranslationUnit(candidate, mainFile);
+
         if (CE->getLocStart().isMacroID()) // Invalidate the function if it's in a macro.
             candidates.invalidate(candidate, "function is used in a macro");
         else
         {
+            // Record the arguments of the call, so versions can be generated by splicing. Only a call that passes
+            // an argument for every parameter can be spliced: a call that relies on default arguments, or passes
+            // variadic ones, doesn't have a slice for every item of the ordering.
+            unsigned nrOfArguments = 0;
+            for (unsigned iii = 0; iii < CE->getNumArgs(); iii++)
+            {
+                if (!isa<CXXDefaultArgExpr>(CE->getArg(iii)))
+                    nrOfArguments++;
+            }
+            if (nrOfArguments != FD->getNumParams())
+                candidates.setUnspliceable(candidate);
+            else if (CE->getNumArgs() > 0)
+            {
+                const SourceManager& sm = astContext.getSourceManager();
+                SourceSite site("0", ", ", ", ");
+                bool spliceable = true;
+                for (unsigned iii = 0; iii < CE->getNumArgs(); iii++)
+                {
+                    const SourceRange& range = CE->getArg(iii)->getSourceRange();
+                    const SourceRange rangeExpanded(sm.getExpansionRange(range.getBegin()).first, sm.getExpansionRange(range.getEnd()).second);
+                    spliceable = spliceable && site.addSlice(rangeExpanded, location2str(rangeExpanded, astContext), astContext);
+                }
+                if (spliceable)
+                    candidates.addSite(candidate, site);
+                else
+                    candidates.setUnspliceable(candidate);
+            }
+
             // Check if any of the argument expression has side effects. In this case we invalidate the function.
             // If one of the arguments is a macro we can't be sure if it has any side effects or not, therefore
             // we assume the worst and invalidate the function.
@@ -66,6 +99,28 @@ bool FunctionUnique::Analyser::VisitCallExpr(clang::CallExpr* CE) {
 
 // AST visitor, used for analysis.
 bool FunctionUnique::Analyser::VisitFunctionDecl(clang::FunctionDecl* FD) {
+    // Every translation unit declaring the function has to be rewritten.
+    {
+        const FunctionUnique candidate(FD, astContext);
+        if (candidate.getFileName().find(metadata.baseDirectory) != std::string::npos) {
+            candidates.addTranslationUnit(candidate, mainFile);
+
+            // Record the parameters of every declaration that can be a candidate, so versions can be generated by splicing.
+            if (!FD->isVariadic() && FD->param_size() > 1) {
+                SourceSite site("int XXX", ", ", ", ");
+                bool spliceable = true;
+                for (unsigned iii = 0; iii < FD->getNumParams(); iii++) {
+                    const ParmVarDecl* param = FD->getParamDecl(iii);
+                    spliceable = spliceable && site.addSlice(param->getSourceRange(), param->getType().getAsString() + " " + param->getNameAsString(), astContext);
+                }
+                if (spliceable)
+                    candidates.addSite(candidate, site);
+                else
+                    candidates.setUnspliceable(candidate);
+            }
+        }
+    }
+
     // We make sure we iterate over the definition.
     if (FD->isThisDeclarationADefinition()) {
         // If we haven't already selected the function, check if the function is eligible:
@@ -83,7 +138,7 @@ bool FunctionUnique::Analyser::VisitFunctionDecl(clang::FunctionDecl* FD) {
             FunctionUnique::Data& data = candidates.get(candidate);
             if (data.valid && data.empty())
             {
-                llvm::outs() << "Found valid candidate: " << candidate.getName() << "\n";
+                candidates.log() << "Found valid candidate: " << candidate.getName() << "\n";
                 data.addParams(FD);
             }
         }
@@ -92,125 +147,165 @@ bool FunctionUnique::Analyser::VisitFunctionDecl(clang::FunctionDecl* FD) {
     return true;
 }
 
+// AST locator, used for finding the nodes of the targets.
+bool FunctionUnique::Locator::VisitCallExpr(clang::CallExpr* CE) {
+    if (FunctionDecl* FD = CE->getDirectCallee()) {
+        if (FunctionUnique::Nodes* found = lookup(FunctionUnique(FD, astContext)))
+            found->calls.push_back(CE);
+    }
+    return true;
+}
+
+// AST locator, used for finding the nodes of the targets.
+bool FunctionUnique::Locator::VisitFunctionDecl(clang::FunctionDecl* FD) {
+    if (FunctionUnique::Nodes* found = lookup(FunctionUnique(FD, astContext)))
+        found->decls.push_back(FD);
+    return true;
+}
+
 // AST rewriter, used for rewriting source code.
 bool FPReorderingRewriter::VisitCallExpr(clang::CallExpr* CE) {
     // We try to get the callee of this function call.
     if (FunctionDecl* FD = CE->getDirectCallee()) {
         // We check if this function is to be reordered
         const FunctionUnique target(FD, astContext);
-        if (transformation.target == target) {
-            llvm::outs() << "Call to function: " << FD->getNameAsString() << " has to be rewritten!\n";
-
-            auto ordering = transformation.ordering;
-            for (unsigned iii = 0; iii < CE->getNumArgs(); iii++)
-            {
-                const SourceRange& oldRange = CE->getArg(iii)->getSourceRange();
-                const SourceRange& newRange = CE->getArg(ordering[iii])->getSourceRange();
-                const SourceRange oldRangeExpanded(astContext.getSourceManager().getExpansionRange(oldRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(oldRange.getEnd()).second);
-                const SourceRange newRangeExpanded(astContext.getSourceManager().getExpansionRange(newRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(newRange.getEnd()).second);
-
-                // We replace the argument with another one based on the ordering.
-                const std::string substitute = location2str(newRangeExpanded, astContext);
-                rewriter.ReplaceText(oldRangeExpanded, substitute);
-            }
-        }
+        if (transformation.target == target)
+            rewriteCallExpr(CE);
     }
     return true;
 }
 
+void FPReorderingRewriter::rewriteCallExpr(clang::CallExpr* CE) {
+    logs() << "Call to function: " << transformation.target.getName() << " has to be rewritten!\n";
+
+    auto ordering = transformation.ordering;
+    for (unsigned iii = 0; iii < CE->getNumArgs(); iii++)
+    {
+        const SourceRange& oldRange = CE->getArg(iii)->getSourceRange();
+        const SourceRange& newRange = CE->getArg(ordering[iii])->getSourceRange();
+        const SourceRange oldRangeExpanded(astContext.getSourceManager().getExpansionRange(oldRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(oldRange.getEnd()).second);
+        const SourceRange newRangeExpanded(astContext.getSourceManager().getExpansionRange(newRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(newRange.getEnd()).second);
+
+        // We replace the argument with another one based on the ordering.
+        const std::string substitute = location2str(newRangeExpanded, astContext);
+        rewriter.ReplaceText(oldRangeExpanded, substitute);
+    }
+}
+
 // AST rewriter, used for rewriting source code.
 bool FPReorderingRewriter::VisitFunctionDecl(clang::FunctionDecl* FD) {
     // Check if this is a declaration for the function that is to be reordered
     FunctionUnique target(FD, astContext);
-    if (transformation.target == target) {
-        llvm::outs() << "Rewriting function: " << FD->getNameAsString() << " definition: " << FD->isThisDeclarationADefinition() << "\n";
+    if (transformation.target == target)
+        rewriteFunctionDecl(FD);
 
-        // We iterate over all parameters in the function declaration.
-        const auto ordering = transformation.ordering;
-        for (unsigned iii = 0; iii < FD->getNumParams(); iii++) {
-            const ParmVarDecl* oldParam = FD->getParamDecl(iii);
-            const ParmVarDecl* newParam = FD->getParamDecl(ordering[iii]);
+    return true;
+}
 
-            std::string name = newParam->getNameAsString();
-            std::string type = newParam->getType().getAsString();
-            std::string substitute = type + " " + name;
+void FPReorderingRewriter::rewriteFunctionDecl(clang::FunctionDecl* FD) {
+    logs() << "Rewriting function: " << FD->getNameAsString() << " definition: " << FD->isThisDeclarationADefinition() << "\n";
 
-            // We replace the field with the new field information.
-            rewriter.ReplaceText(oldParam->getSourceRange(), substitute);
-        }
-    }
+    // We iterate over all parameters in the function declaration.
+    const auto ordering = transformation.ordering;
+    for (unsigned iii = 0; iii < FD->getNumParams(); iii++) {
+        const ParmVarDecl* oldParam = FD->getParamDecl(iii);
+        const ParmVarDecl* newParam = FD->getParamDecl(ordering[iii]);
 
-    return true;
+        std::string name = newParam->getNameAsString();
+        std::string type = newParam->getType().getAsString();
+        std::string substitute = type + " " + name;
+
+        // We replace the field with the new field information.
+        rewriter.ReplaceText(oldParam->getSourceRange(), substitute);
+    }
 }
 
+void FPReorderingRewriter::rewriteNodes(const FunctionUnique::Nodes& nodes) {
+    for (auto FD : nodes.decls)
+        rewriteFunctionDecl(FD);
+    for (auto CE : nodes.calls)
+        rewriteCallExpr(CE);
+}
 
 bool FPInsertionRewriter::VisitCallExpr(clang::CallExpr* CE) {
     // We try to get the callee of this function call.
     if (FunctionDecl* FD = CE->getDirectCallee()) {
         // We check if this function is to be reordered
         const FunctionUnique target(FD, astContext);
-        if (transformation.target == target) {
-            llvm::outs() << "Call to function: " << FD->getNameAsString() << " has to be rewritten!\n";
+        if (transformation.target == target)
+            rewriteCallExpr(CE);
+    }
 
-            int newArg = 0;
+    return true;
+}
 
-            if (transformation.insertionPoint < CE->getNumArgs())
-            {
-                const SourceRange& range = CE->getArg(transformation.insertionPoint)->getSourceRange();
-                const SourceRange rangeExpanded(astContext.getSourceManager().getExpansionRange(range.getBegin()).first, astContext.getSourceManager().getExpansionRange(range.getEnd()).second);
+void FPInsertionRewriter::rewriteCallExpr(clang::CallExpr* CE) {
+    logs() << "Call to function: " << transformation.target.getName() << " has to be rewritten!\n";
 
-                // We replace the argument with another one based on the ordering.
-                const std::string substitute = std::to_string(newArg) + ", " + location2str(rangeExpanded, astContext);
-                rewriter.ReplaceText(rangeExpanded, substitute);
-            }
-            else
-            {
-                const SourceRange& range = CE->getArg(CE->getNumArgs() -1)->getSourceRange();
-                const SourceRange rangeExpanded(astContext.getSourceManager().getExpansionRange(range.getBegin()).first, astContext.getSourceManager().getExpansionRange(range.getEnd()).second);
+    int newArg = 0;
 
-                // We replace the argument with another one based on the ordering.
-                const std::string substitute = location2str(rangeExpanded, astContext) + ", " + std::to_string(newArg);
-                rewriter.ReplaceText(rangeExpanded, substitute);
-            }
-        }
+    if (transformation.insertionPoint < CE->getNumArgs())
+    {
+        const SourceRange& range = CE->getArg(transformation.insertionPoint)->getSourceRange();
+        const SourceRange rangeExpanded(astContext.getSourceManager().getExpansionRange(range.getBegin()).first, astContext.getSourceManager().getExpansionRange(range.getEnd()).second);
+
+        // We replace the argument with another one based on the ordering.
+        const std::string substitute = std::to_string(newArg) + ", " + location2str(rangeExpanded, astContext);
+        rewriter.ReplaceText(rangeExpanded, substitute);
     }
+    else
+    {
+        const SourceRange& range = CE->getArg(CE->getNumArgs() -1)->getSourceRange();
+        const SourceRange rangeExpanded(astContext.getSourceManager().getExpansionRange(range.getBegin()).first, astContext.getSourceManager().getExpansionRange(range.getEnd()).second);
 
-    return true;
+        // We replace the argument with another one based on the ordering.
+        const std::string substitute = location2str(rangeExpanded, astContext) + ", " + std::to_string(newArg);
+        rewriter.ReplaceText(rangeExpanded, substitute);
+    }
 }
 
-
 bool FPInsertionRewriter::VisitFunctionDecl(clang::FunctionDecl* FD) {
     // Check if this is a declaration for the function that is to be reordered
     FunctionUnique target(FD, astContext);
-    if (transformation.target == target) {
-        llvm::outs() << "Rewriting function: " << FD->getNameAsString() << " definition: " << FD->isThisDeclarationADefinition() << "\n";
+    if (transformation.target == target)
+        rewriteFunctionDecl(FD);
 
-        const ParmVarDecl* param;
-        bool before;
-        if (transformation.insertionPoint < FD->getNumParams())
-        {
-            param = FD->getParamDecl(transformation.insertionPoint);
-            before = true;
-        }
-        else
-        {
-            param = FD->getParamDecl(FD->getNumParams() -1);
-            before = false;
-        }
-
-        std::string name = param->getNameAsString();
-        std::string type = param->getType().getAsString();
-        std::string substitute = type + " " + name;
-        std::string newParam = "int XXX";
+    return true;
+}
 
-        if (before)
-            substitute =  newParam + ", " + substitute;
-        else
-            substitute = substitute + ", " + newParam;
+void FPInsertionRewriter::rewriteFunctionDecl(clang::FunctionDecl* FD) {
+    logs() << "Rewriting function: " << FD->getNameAsString() << " definition: " << FD->isThisDeclarationADefinition() << "\n";
 
-        // We replace the field with the new field information.
-        rewriter.ReplaceText(param->getSourceRange(), substitute);
+    const ParmVarDecl* param;
+    bool before;
+    if (transformation.insertionPoint < FD->getNumParams())
+    {
+        param = FD->getParamDecl(transformation.insertionPoint);
+        before = true;
+    }
+    else
+    {
+        param = FD->getParamDecl(FD->getNumParams() -1);
+        before = false;
     }
 
-    return true;
+    std::string name = param->getNameAsString();
+    std::string type = param->getType().getAsString();
+    std::string substitute = type + " " + name;
+    std::string newParam = "int XXX";
+
+    if (before)
+        substitute =  newParam + ", " + substitute;
+    else
+        substitute = substitute + ", " + newParam;
+
+    // We replace the field with the new field information.
+    rewriter.ReplaceText(param->getSourceRange(), substitute);
+}
+
+void FPInsertionRewriter::rewriteNodes(const FunctionUnique::Nodes& nodes) {
+    for (auto FD : nodes.decls)
+        rewriteFunctionDecl(FD);
+    for (auto CE : nodes.calls)
+        rewriteCallExpr(CE);
 }
@@ -8,6 +8,7 @@
 #include "clang/AST/Decl.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -16,6 +17,12 @@ class FunctionUnique : public TargetUnique {
         FunctionUnique(const clang::FunctionDecl* D, const clang::ASTContext& astContext)
             : TargetUnique(D->getNameAsString(), astContext.getSourceManager().getFilename(D->getLocation()).str(), D->isGlobal()) {}
 
+        FunctionUnique(const std::string& name, const std::string& fileName, bool global)
+            : TargetUnique(name, fileName, global) {}
+
+        // The kind of targets, which identifies their candidate database.
+        static const char* getKind() { return "function"; }
+
         class Data : public TargetUnique::Data {
             struct FunctionParam {
                 std::string name;
@@ -35,6 +42,13 @@ class FunctionUnique : public TargetUnique {
                     params.emplace_back(param->getNameAsString(), param->getType().getAsString());
                 }
             }
+            void merge(const TargetUnique::Data& other) {
+                // Like during analysis, the items are only taken if we don't know them yet
+                const Data& data = static_cast<const Data&>(other);
+                if (valid && params.empty())
+                    params = data.params;
+                TargetUnique::Data::merge(other);
+            }
             bool empty() const {
                 return params.empty();
             }
@@ -53,6 +67,22 @@ class FunctionUnique : public TargetUnique {
             unsigned nrOfItems() const {
                 return params.size();
             }
+            void serialize(BinaryWriter& writer) const {
+                TargetUnique::Data::serialize(writer);
+                writer.writeU32(params.size());
+                for (const auto& param : params) {
+                    writer.writeString(param.name);
+                    writer.writeString(param.type);
+                }
+            }
+            void deserialize(BinaryReader& reader) {
+                TargetUnique::Data::deserialize(reader);
+                const uint32_t nrOfParams = reader.readU32();
+                for (uint32_t iii = 0; iii < nrOfParams && reader.ok(); iii++) {
+                    const std::string name = reader.readString();
+                    params.emplace_back(name, reader.readString());
+                }
+            }
         };
 
         // Semantic analyser, willl analyse different nodes within the AST.
@@ -66,6 +96,22 @@ class FunctionUnique : public TargetUnique {
                 bool VisitCallExpr(clang::CallExpr* CE);
                 bool VisitFunctionDecl(clang::FunctionDecl* D);
         };
+
+        // The nodes of a translation unit that have to be rewritten for a target.
+        struct Nodes {
+            std::vector<clang::FunctionDecl*> decls;
+            std::vector<clang::CallExpr*> calls;
+        };
+
+        // Semantic locator, will look up the nodes for a set of targets in a single traversal.
+        class Locator : public SemanticLocator<FunctionUnique>, public clang::RecursiveASTVisitor<Locator> {
+            public:
+                explicit Locator(clang::ASTContext& Context, std::map<FunctionUnique, Nodes>& nodes)
+                    : SemanticLocator(Context, nodes) {}
+
+                bool VisitCallExpr(clang::CallExpr* CE);
+                bool VisitFunctionDecl(clang::FunctionDecl* D);
+        };
 };
 
 // Semantic Rewriter, will rewrite source code based on the AST.
@@ -73,7 +119,7 @@ class FPReorderingRewriter : public SemanticRewriter, public clang::RecursiveAST
     private:
         const ReorderingTransformation& transformation;
     public:
-        explicit FPReorderingRewriter(clang::ASTContext& Context, const Transformation& transformation, clang::Rewriter& rewriter)
+        explicit FPReorderingRewriter(clang::ASTContext& Context, const Transformation& transformation, RecordingRewriter& rewriter)
           : SemanticRewriter(Context, rewriter), transformation(static_cast<const ReorderingTransformation&>(transformation)) {}
 
         // We need to rewrite calls to these reordered functions.
@@ -82,6 +128,11 @@ class FPReorderingRewriter : public SemanticRewriter, public clang::RecursiveAST
         // We want to investigate FunctionDecl's.
         bool VisitFunctionDecl(clang::FunctionDecl* D);
 
+        // Rewrite nodes that are known to belong to the target.
+        void rewriteCallExpr(clang::CallExpr* CE);
+        void rewriteFunctionDecl(clang::FunctionDecl* D);
+        void rewriteNodes(const FunctionUnique::Nodes& nodes);
+
         typedef FunctionUnique Target;
         typedef ReorderingTransformation TransformationType;
 };
@@ -91,7 +142,7 @@ class FPInsertionRewriter : public SemanticRewriter, public clang::RecursiveASTV
     private:
         const InsertionTransformation& transformation;
     public:
-        explicit FPInsertionRewriter(clang::ASTContext& Context, const Transformation& transformation, clang::Rewriter& rewriter)
+        explicit FPInsertionRewriter(clang::ASTContext& Context, const Transformation& transformation, RecordingRewriter& rewriter)
           : SemanticRewriter(Context, rewriter), transformation(static_cast<const InsertionTransformation&>(transformation)) {}
 
         // We need to rewrite calls to these reordered functions.
@@ -100,6 +151,11 @@ class FPInsertionRewriter : public SemanticRewriter, public clang::RecursiveASTV
         // We want to investigate FunctionDecl's.
         bool VisitFunctionDecl(clang::FunctionDecl* D);
 
+        // Rewrite nodes that are known to belong to the target.
+        void rewriteCallExpr(clang::CallExpr* CE);
+        void rewriteFunctionDecl(clang::FunctionDecl* D);
+        void rewriteNodes(const FunctionUnique::Nodes& nodes);
+
         typedef FunctionUnique Target;
         typedef InsertionTransformation TransformationType;
 };
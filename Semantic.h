@@ -1,38 +1,187 @@
 #ifndef _SEMANTIC
 #define _SEMANTIC
 
+#include "SemanticASTCache.h"
+#include "SemanticArchive.h"
 #include "SemanticData.h"
+#include "SemanticDatabase.h"
 #include "SemanticFrontendAction.h"
+#include "SemanticGit.h"
+#include "SemanticIOUring.h"
+#include "SemanticMaterialize.h"
+#include "SemanticOutput.h"
+#include "SemanticOverlay.h"
+#include "SemanticPipeline.h"
+#include "SemanticPreamble.h"
+#include "SemanticScheduler.h"
+#include "SemanticSnapshot.h"
 #include "SemanticUtil.h"
 
+#include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include "json.h"
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <numeric>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+// Method used to run the analysis phase. With multiple jobs the translation units are analysed concurrently,
+// largest first, each into its own candidates table. The tables (and their messages) are merged in the
+// order of the source paths, so the result doesn't depend on the scheduling of the threads. With the
+// analysis cache, the tables of the translation units that didn't change are read from the candidate
+// database, and only the other ones are analysed (and written to the database). Multiple jobs may only be used
+// when the compile commands only use absolute paths (see usesAbsolutePaths).
+template <typename TargetType>
+void analyseTranslationUnits(const clang::tooling::CompilationDatabase& compilations, const std::vector<std::string>& sourcePaths, const MetaData& metadata, const GenerationOptions& options, unsigned jobs, const std::string& databasePath, Candidates<TargetType>& candidates) {
+    if (jobs <= 1 && !options.analysisCache) {
+        clang::tooling::ClangTool Tool(compilations, sourcePaths);
+        Tool.run(new AnalysisFrontendActionFactory<TargetType>(metadata, candidates));
+        return;
+    }
+
+    // Every translation unit gets its own table and log.
+    std::vector<std::string> logs(sourcePaths.size());
+    std::vector<std::unique_ptr<llvm::raw_string_ostream>> streams;
+    std::vector<std::unique_ptr<Candidates<TargetType>>> tables;
+    for (auto& log : logs) {
+        streams.emplace_back(new llvm::raw_string_ostream(log));
+        tables.emplace_back(new Candidates<TargetType>(*streams.back()));
+    }
+
+    // Look up the tables in the candidate database. Only the translation units whose entry isn't up to
+    // date (because the translation unit or one of its dependencies changed) are analysed again. The
+    // validity of a candidate is then recomputed by merging all tables again, so an invalidation by a
+    // translation unit that didn't change is replayed from its stored table.
+    CandidateDatabase database(databasePath, CandidateDatabase::hashConfiguration(TargetType::getKind(), metadata.baseDirectory));
+    std::vector<uint64_t> commandHashes(sourcePaths.size(), 0);
+    std::vector<size_t> stale;// The translation units that have to be analysed
+    if (options.analysisCache)
+        database.load();
+    for (size_t iii = 0; iii < sourcePaths.size(); iii++) {
+        if (options.analysisCache) {
+            commandHashes[iii] = CandidateDatabase::hashCompileCommands(compilations, sourcePaths[iii]);
+            const CandidateDatabase::Unit* unit = database.lookup(sourcePaths[iii], commandHashes[iii]);
+            if (unit) {
+                BinaryReader reader(unit->table);
+                if (tables[iii]->deserialize(reader))
+                    continue;
+
+                // Start over from an empty table.
+                tables[iii].reset(new Candidates<TargetType>(*streams[iii]));
+            }
+        }
+        stale.push_back(iii);
+    }
+    if (options.analysisCache)
+        llvm::outs() << "Phase 1: reusing the candidates of " << (sourcePaths.size() - stale.size()) << " translation units from "
+                     << database.getPath() << ", analysing " << stale.size() << " translation units\n";
+
+    // Schedule the largest translation units first, to avoid a long tail.
+    std::vector<uint64_t> sizes(sourcePaths.size(), 0);
+    for (auto index : stale)
+        llvm::sys::fs::file_size(sourcePaths[index], sizes[index]);
+    std::stable_sort(stale.begin(), stale.end(), [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    if (!stale.empty()) {
+        llvm::ThreadPool pool(std::max(jobs, 1u));
+        for (auto index : stale) {
+            pool.async([&, index]() {
+                clang::tooling::ClangTool Tool(compilations, sourcePaths[index]);
+                AnalysisFrontendActionFactory<TargetType> factory(metadata, *tables[index]);
+                Tool.run(&factory);
+                streams[index]->flush();
+            });
+        }
+        pool.wait();
+    }
+
+    // Store the tables of the analysed translation units.
+    if (options.analysisCache && !stale.empty()) {
+        size_t stored = 0;
+        for (auto index : stale) {
+            BinaryWriter writer;
+            tables[index]->serialize(writer);
+            std::string missing;
+            if (database.store(sourcePaths[index], commandHashes[index], tables[index]->getDependencies(), writer.data(), missing))
+                stored++;
+            else
+                llvm::errs() << "Warning: not storing the candidates of " << sourcePaths[index] << ", as " << missing << " can't be read\n";
+        }
+        if (database.save())
+            llvm::outs() << "Phase 1: stored the candidates of " << stored << " translation units in " << database.getPath() << "\n";
+    }
+
+    // Merge the tables in a deterministic order.
+    for (size_t iii = 0; iii < sourcePaths.size(); iii++) {
+        llvm::outs() << logs[iii];
+        candidates.merge(*tables[iii]);
+    }
+}
+
 // Method used to generate new versions
 template <typename RewriterType>
-void generateVersions(clang::tooling::ClangTool* Tool, const std::string& baseDirectory, const std::string& outputDirectory, const unsigned long numberOfVersions) {
+void generateVersions(const clang::tooling::CompilationDatabase& compilations, const std::vector<std::string>& sourcePaths, const std::string& baseDirectory, const std::string& outputDirectory, const unsigned long numberOfVersions, const GenerationOptions& options) {
     typedef typename RewriterType::Target TargetType;
     typedef typename RewriterType::TransformationType TransformationType;
 
     const MetaData metadata(baseDirectory, outputDirectory);
 
+    // Only version directories with the rewritten files can be completed into full source trees, or be
+    // overlaid on the base directory.
+    const bool versionDirectories = !options.patch
+        && (options.outputBackend == GenerationOptions::DirectoryOutput || options.outputBackend == GenerationOptions::IOUringOutput);
+    const bool materialize = options.materialize && versionDirectories;
+    if (options.materialize && !materialize)
+        llvm::errs() << "Warning: full source trees are only materialized for the posix and io_uring outputs, without patches\n";
+    const bool overlay = options.vfsOverlay && versionDirectories;
+    if (options.vfsOverlay && !overlay)
+        llvm::errs() << "Warning: VFS overlays are only written for the posix and io_uring outputs, without patches\n";
+
+    // With I/O threads, the output files are written in the background.
+    VersionOutput output(options.patch, overlay);
+    std::unique_ptr<OutputBackend> backend;
+    if (options.outputBackend == GenerationOptions::IOUringOutput)
+        backend = createIOUringBackend();
+    else if (options.outputBackend == GenerationOptions::PackOutput)
+        backend.reset(new PackBackend(outputDirectory + "versions.pack"));
+    else if (options.outputBackend == GenerationOptions::TarOutput)
+        backend.reset(new TarBackend());
+    else if (options.outputBackend == GenerationOptions::GitOutput)
+        backend.reset(new GitBackend(outputDirectory + "versions.git"));
+    else
+        backend.reset(new DirectoryBackend());
+    output.writer.configure(std::move(backend), options.outputThreads, options.maxInFlightOutput);
+
+    // ClangTool changes the working directory of the process to that of the compile command, so translation units
+    // are only parsed by multiple threads at once when their compile commands don't depend on it.
+    unsigned jobs = options.jobs;
+    std::string relativePath;
+    if (jobs > 1 && !usesAbsolutePaths(compilations, sourcePaths, relativePath)) {
+        llvm::outs() << "Running a single job, as " << relativePath << "\n";
+        jobs = 1;
+    }
+
     // We run the analysis phase and get the valid candidates
     Candidates<TargetType> analysis_candidates;
-    Tool->run(new AnalysisFrontendActionFactory<TargetType>(metadata, analysis_candidates));
+    analyseTranslationUnits(compilations, sourcePaths, metadata, options, jobs, outputDirectory + "candidates." + TargetType::getKind() + ".db", analysis_candidates);
     auto candidates = analysis_candidates.select_valid();
 
     // Calculate some statistics based on the candidates
     std::map<unsigned, unsigned> histogram;
     unsigned long totalItems = 0;
-    unsigned long totalVersions = 0;
+    VersionCount totalVersions = 0;
     TransformationType::calculateStatistics(candidates, histogram, totalItems, totalVersions);
 
     // Create analytics
@@ -40,6 +189,7 @@ void generateVersions(clang::tooling::ClangTool* Tool, const std::string& baseDi
     analytics["number_of_candidates"] = candidates.size();
     analytics["avg_items"] = totalItems / candidates.size();
     analytics["entropy"] = entropyEquiprobable(totalVersions);
+    analytics["total_versions"] = totalVersions.toString();// As a string, the count doesn't necessarily fit in 64 bits
 
     // Add histogram.
     for (const auto& it : histogram) {
@@ -50,50 +200,331 @@ void generateVersions(clang::tooling::ClangTool* Tool, const std::string& baseDi
 
     // Output analytics
     llvm::outs() << "Writing analytics output...\n";
-    writeJSONToFile(outputDirectory, -1, "analytics.json", analytics);
+    writeJSONToFile(output.writer, outputDirectory, -1, "analytics.json", analytics);
+
+    unsigned long actualNumberOfVersions = (VersionCount(numberOfVersions) < totalVersions) ? numberOfVersions : totalVersions.toUInt64();
+
+    // The sampler numbers all versions of all candidates, and maps every version id onto a distinct one.
+    std::vector<VersionCount> versionCounts;
+    for (const auto& candidate : candidates)
+        versionCounts.push_back(TransformationType::versionCount(candidate.second));
+    const VersionSampler sampler(versionCounts, options.seed);
+    FingerprintSet generated;// The fingerprints of the versions generated by uniform sampling
 
-    unsigned long actualNumberOfVersions = std::min(numberOfVersions, totalVersions);
-    std::vector<TransformationType> transformations;
-    llvm::outs() << "Total number of versions possible with " << candidates.size() << " candidates is: " << totalVersions << "\n";
+    // When (nearly) all versions are requested, we enumerate them instead of unranking them. The other sampling
+    // policies are kept, they were asked for explicitly (e.g. to compare them).
+    const bool saturated = options.saturation > 0 && totalVersions.fitsIn64() && numberOfVersions >= options.saturation * totalVersions.toUInt64();
+    const bool enumerate = (options.sampling == GenerationOptions::EnumerateSampling) || (options.sampling == GenerationOptions::UnrankSampling && saturated);
+    VersionEnumerator enumerator(versionCounts);
+
+    // The weighted sampler is only built when the versions are sampled by weight.
+    std::unique_ptr<WeightedVersionSampler> weightedSampler;
+    if (!enumerate && options.sampling == GenerationOptions::WeightedSampling)
+        weightedSampler.reset(new WeightedVersionSampler(versionCounts, options.seed));
+
+    llvm::outs() << "Total number of versions possible with " << candidates.size() << " candidates is: " << totalVersions.toString()
+                 << " (2^" << entropyEquiprobable(totalVersions) << ")\n";
     llvm::outs() << "The actual number of versions is set to: " << actualNumberOfVersions << "\n";
-    for (unsigned long versionId = 1; versionId <= actualNumberOfVersions; versionId++)
+    if (enumerate)
+        llvm::outs() << "Enumerating the versions " << (options.shuffleEnumeration ? "in shuffled order" : "in order") << "\n";
+    else if (saturated)
+        llvm::outs() << "Sampling the versions as requested, although at least " << options.saturation << " of all versions is requested\n";
+
+    auto generateNewCandidatePair = [&](unsigned long versionId) -> std::pair<size_t, TransformationType>
     {
-        auto generateNewCandidatePair = [&candidates, &transformations]()
+        // Walk the (candidate, rank) pairs in order, or map the version onto a distinct global index
+        // and the global index onto a candidate and a rank.
+        if (enumerate || options.sampling == GenerationOptions::UnrankSampling) {
+            const auto location = (enumerate && !options.shuffleEnumeration) ? enumerator.next() : sampler.locate(sampler.sample(versionId - 1));
+            const auto& candidate = candidates[location.first];
+            return std::make_pair(location.first, TransformationType(candidate.first, candidate.second, location.second));
+        }
+
+        // Every version draws from its own random stream, so it doesn't depend on the draws of other versions.
+        RandomStream random(options.seed, versionId);
+        if (weightedSampler) {
+            const auto location = weightedSampler->sample(random);
+            const auto& candidate = candidates[location.first];
+            return std::make_pair(location.first, TransformationType(candidate.first, candidate.second, location.second));
+        }
+
+        while (true)
+        {
+            // We choose a candidate at random.
+            const size_t index = random.random_0_to_n(candidates.size() -1);
+            const auto& candidate = candidates[index];
+
+            // Generate a transformation for this candidate
+            TransformationType transformation(candidate.first, candidate.second, random);
+
+            // Check if this transformation isn't duplicate. If it is, we try again
+            if (generated.insert(transformation.fingerprint()))
+                return std::make_pair(index, transformation);
+        }
+    };
+
+    // Phase 2 is split into independent tasks: splicing a version, or rewriting a single translation unit
+    // for a version or for a fused batch of versions. The tasks are executed on a work-stealing pool, in
+    // which every worker has its own ASTs (when reusing them), compiler instances and rewriters. Like the
+    // analysis, it only uses multiple workers when the compile commands don't depend on the working directory.
+    WorkStealingPool pool(jobs);
+
+    // A file that is left in a version directory by an earlier run would be taken for a rewritten file, so
+    // the version directories are removed before they are completed.
+    if (materialize) {
+        for (unsigned long versionId = 1; versionId <= actualNumberOfVersions; versionId++)
+            pool.add([&, versionId](unsigned worker) {
+                llvm::sys::fs::remove_directories(getVersionDirectory(metadata.outputPrefix, versionId));
+            });
+        pool.run();
+    }
+
+    // ASTs that are loaded from a snapshot are always reused.
+    std::unique_ptr<ASTSnapshotStore> snapshots;
+    if (!options.astSnapshotDirectory.empty())
+        snapshots.reset(new ASTSnapshotStore(compilations, options.astSnapshotDirectory, options.astSnapshotCapacity));
+    std::vector<std::unique_ptr<ASTCache>> astCaches;
+    if (options.reuseASTs || snapshots) {
+        for (unsigned iii = 0; iii < pool.size(); iii++)
+            astCaches.emplace_back(new ASTCache(compilations, options.astMemoryBudget / pool.size(), snapshots.get()));
+    }
+
+    // Every translation unit is rewritten from the cache of a single worker, so it is only parsed (and kept in
+    // memory) once. The translation units are spread over the workers by size, the largest ones first.
+    std::map<std::string, unsigned> owners;
+    std::vector<uint64_t> ownedSizes(pool.size(), 0);
+    auto getOwner = [&](const std::string& sourcePath) -> unsigned {
+        auto it = owners.find(sourcePath);
+        if (it != owners.end())
+            return it->second;
+
+        uint64_t size = 0;
+        llvm::sys::fs::file_size(sourcePath, size);
+        const unsigned owner = std::min_element(ownedSizes.begin(), ownedSizes.end()) - ownedSizes.begin();
+        ownedSizes[owner] += std::max(size, (uint64_t)1);
+        owners[sourcePath] = owner;
+        return owner;
+    };
+    if (!astCaches.empty()) {
+        std::vector<std::pair<uint64_t, std::string>> units;
+        for (const auto& sourcePath : sourcePaths) {
+            uint64_t size = 0;
+            llvm::sys::fs::file_size(sourcePath, size);
+            units.push_back(std::make_pair(size, sourcePath));
+        }
+        std::stable_sort(units.begin(), units.end(), [](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b) { return a.first > b.first; });
+        for (const auto& unit : units)
+            getOwner(unit.second);
+    }
+
+    // When translation units are parsed again for every version (or batch), the headers they include
+    // are only parsed once, into a precompiled preamble.
+    std::unique_ptr<PreambleCache> preambles;
+    if (options.reusePreambles)
+        preambles.reset(new PreambleCache());
+
+    // The versions are chosen and rewritten in windows, so only the transformations of a single window
+    // are kept in memory, and the next window is chosen while the current one is rewritten. In fused mode,
+    // every window is a batch: every translation unit is traversed once per batch of versions, instead of
+    // once per version. Enumerating all versions of a project thus streams the versions into phase 2.
+    const unsigned long windowSize = options.batchSize ? options.batchSize : options.window;
+    struct Window {
+        unsigned long start;
+        std::vector<TransformationType> transformations;// The rewrite tasks point into this vector.
+        std::vector<const TargetUnique::Data*> transformationData;// The data of the target of every transformation.
+    };
+
+    // The compilation database of every version contains the compile commands of all translation units.
+    std::vector<clang::tooling::CompileCommand> compileCommands;
+    if (overlay) {
+        unsigned withoutOverlay = 0;
+        for (const auto& sourcePath : sourcePaths) {
+            for (auto& command : compilations.getCompileCommands(sourcePath)) {
+                if (!acceptsVFSOverlay(command))
+                    withoutOverlay++;
+                compileCommands.push_back(std::move(command));
+            }
+        }
+        if (withoutOverlay > 0)
+            llvm::errs() << "Warning: " << withoutOverlay << " compile commands don't use clang, they are written without the VFS overlay\n";
+    }
+
+    // Phase 2 is a pipeline of three stages. The selection stage chooses the versions of a window (on its own
+    // thread), the rewrite stage rewrites them (on the pool) and the write stage writes the rewritten files
+    // (on the I/O threads of the output writer). The selection stage only runs a single window ahead, so at
+    // most two windows are kept in memory.
+    BoundedQueue<Window> windows(1);
+    std::thread selection([&] {
+        for (unsigned long windowStart = 1; windowStart <= actualNumberOfVersions; windowStart += windowSize)
         {
-            while (true)
+            const unsigned long windowEnd = std::min(actualNumberOfVersions, windowStart + windowSize - 1);
+            Window window;
+            window.start = windowStart;
+            window.transformations.reserve(windowEnd - windowStart + 1);
+
+            for (unsigned long versionId = windowStart; versionId <= windowEnd; versionId++)
             {
-                // We choose a candidate at random.
-                const auto& candidate = candidates[random_0_to_n(candidates.size() -1)];
-
-                // Generate a transformation for this candidate
-                TransformationType transformation(candidate.first, candidate.second);
-
-                // Check if this transformation isn't duplicate. If it is, we try again
-                bool duplicate = false;
-                for (const auto& t : transformations) {
-                    if (t == transformation) {
-                        duplicate = true;
-                        break;
+                LogBuffer buffer;
+                auto pair = generateNewCandidatePair(versionId);
+                const auto& candidate = candidates[pair.first];
+                TransformationType transformation = pair.second;
+
+                // We write some information regarding the performed transformations to output.
+                transformation.outputDebugInfo();
+                writeJSONToFile(output.writer, metadata.outputPrefix, versionId, "transformations.json", transformation.getJSON(candidate.second));
+
+                // Remember the transformation.
+                window.transformations.push_back(transformation);
+                window.transformationData.push_back(&candidate.second);
+            }
+
+            windows.push(std::move(window), 1);
+        }
+        windows.close();
+    });
+
+    Window window;
+    unsigned long windowCost;
+    while (windows.pop(window, windowCost))
+    {
+        const unsigned long windowStart = window.start;
+        const std::vector<TransformationType>& transformations = window.transformations;
+        const std::vector<const TargetUnique::Data*>& transformationData = window.transformationData;
+
+        VersionBatch<RewriterType> batch;
+        std::map<std::string, std::vector<unsigned long>> unitVersions;// The versions to rewrite every cached translation unit for
+        for (unsigned long index = 0; index < transformations.size(); index++)
+        {
+            const unsigned long versionId = windowStart + index;
+            const TransformationType& transformation = transformations[index];
+            const TargetUnique::Data& data = *transformationData[index];
+
+            // When all sites of the target were recorded during analysis, the version is generated
+            // by splicing the original files, without invoking clang.
+            if (options.splice && data.spliceable && !data.sites.empty()) {
+                pool.add([&, versionId, index](unsigned worker) {
+                    logs() << "Phase 2: splicing version: " << versionId << " target name: " << transformations[index].target.getName() << "\n";
+                    std::map<std::string, std::vector<SourceEdit>> edits;
+                    bool spliced = true;
+                    for (const auto& site : transformationData[index]->sites)
+                        spliced = spliced && transformations[index].splice(site, edits[site.fileName]);
+                    if (spliced && spliceVersion(output, metadata.outputPrefix, metadata.baseDirectory, versionId, edits))
+                        return;
+
+                    // A site that doesn't fit the transformation (or a file that changed since the analysis) would
+                    // leave it half applied, so the version is rewritten by clang instead.
+                    logs() << "Phase 2: version " << versionId << " can't be spliced, rewriting it\n";
+                    for (const auto& sourcePath : transformationData[index]->translationUnits) {
+                        clang::tooling::ClangTool VersionTool(compilations, sourcePath);
+                        RewritingFrontendActionFactory<RewriterType> factory(metadata, output, transformations[index], versionId);
+                        runTool(VersionTool, factory, preambles.get());
                     }
+                });
+                continue;
+            }
+
+            // In fused mode the version is rewritten together with the rest of its batch.
+            if (options.fusedRewrite) {
+                batch.add(versionId, transformation, data);
+                continue;
+            }
+
+            // With cached ASTs, the versions are rewritten translation unit by translation unit (below).
+            if (!astCaches.empty()) {
+                for (const auto& sourcePath : data.translationUnits)
+                    unitVersions[sourcePath].push_back(index);
+                continue;
+            }
+
+            // Do the actual transformation, only on the translation units in which the target occurs
+            for (const auto& sourcePath : data.translationUnits) {
+                pool.add([&, versionId, index, sourcePath](unsigned worker) {
+                    clang::tooling::ClangTool VersionTool(compilations, sourcePath);
+                    RewritingFrontendActionFactory<RewriterType> factory(metadata, output, transformations[index], versionId);
+                    runTool(VersionTool, factory, preambles.get());
+                });
+            }
+        }
+
+        // A single task rewrites a translation unit for all versions of the window, so every AST is taken from
+        // the cache once per window. Visiting the translation units once per version instead would access the
+        // cache cyclically, which misses every time when the ASTs don't fit in the budget. The task is executed by
+        // the worker that owns the translation unit.
+        for (const auto& unit : unitVersions) {
+            const std::pair<const std::string, std::vector<unsigned long>>* versions = &unit;
+            pool.add([&, versions](unsigned worker) {
+                clang::ASTUnit* AST = astCaches[worker]->get(versions->first);
+                if (!AST)
+                    return;
+
+                for (auto index : versions->second) {
+                    const TransformationType& transformation = transformations[index];
+                    logs() << "Phase 2: performing rewrite for version: " << (windowStart + index) << " target name: " << transformation.target.getName() << "\n";
+
+                    // Every version gets a fresh rewriter on top of the same AST
+                    RecordingRewriter rewriter;
+                    RewriterType visitor(AST->getASTContext(), transformation, rewriter);
+                    visitor.TraverseDecl(AST->getASTContext().getTranslationUnitDecl());
+                    if (rewriter.buffer_begin() != rewriter.buffer_end())
+                        writeChangesToOutput(output, metadata.outputPrefix, metadata.baseDirectory, windowStart + index, rewriter);
                 }
+            }, getOwner(unit.first));
+        }
+
+        // Only the translation units in which the targets of the batch occur are rewritten
+        for (const auto& sourcePath : batch.getTranslationUnits()) {
+            if (!astCaches.empty()) {
+                pool.add([&, sourcePath](unsigned worker) {
+                    logs() << "Phase 2: performing batched rewrite\n";
+                    clang::ASTUnit* AST = astCaches[worker]->get(sourcePath);
+                    if (!AST)
+                        return;
 
-                if (!duplicate)
-                    return std::make_pair(candidate, transformation);
+                    std::map<unsigned long, RecordingRewriter> rewriters;
+                    batch.rewrite(AST->getASTContext(), rewriters);
+                    VersionBatch<RewriterType>::write(metadata, output, rewriters);
+                }, getOwner(sourcePath));
+            } else {
+                pool.add([&, sourcePath](unsigned worker) {
+                    clang::tooling::ClangTool BatchTool(compilations, sourcePath);
+                    BatchRewritingFrontendActionFactory<RewriterType> factory(metadata, output, batch);
+                    runTool(BatchTool, factory, preambles.get());
+                });
             }
-        };
+        }
 
-        auto pair = generateNewCandidatePair();
-        const auto& candidate = pair.first;
-        TransformationType transformation = pair.second;
+        pool.run();
+
+        // All translation units of the versions of the window have been rewritten, so their patches and overlays
+        // are complete, and what is kept for them can be dropped.
+        for (unsigned long index = 0; index < transformations.size(); index++) {
+            if (options.patch)
+                writePatchToOutput(output, metadata.outputPrefix, windowStart + index);
+            if (overlay)
+                writeOverlayToOutput(output, metadata.outputPrefix, metadata.baseDirectory, windowStart + index, compileCommands);
+            output.release(windowStart + index);
+        }
+        windows.finish(windowCost);
+    }
+    selection.join();
 
-        // We write some information regarding the performed transformations to output.
-        transformation.outputDebugInfo();
-        const Json::Value output = transformation.getJSON(candidate.second);
-        writeJSONToFile(metadata.outputPrefix, versionId, "transformations.json", output);
+    if (!output.writer.finish())
+        llvm::errs() << "Error: not all output files could be written\n";
 
-        // Do the actual transformation and remember it
-        Tool->run(new RewritingFrontendActionFactory<RewriterType>(metadata, transformation, versionId));
-        transformations.push_back(transformation);
+    // Once the rewritten files are written, the versions are completed with the files that weren't rewritten.
+    if (materialize) {
+        llvm::outs() << "Materializing the full source trees...\n";
+        TreeMaterializer materializer(metadata.baseDirectory, outputDirectory);
+        std::atomic<bool> complete(true);
+        for (unsigned long versionId = 1; versionId <= actualNumberOfVersions; versionId++)
+            pool.add([&, versionId](unsigned worker) {
+                if (!materializer.materialize(getVersionDirectory(metadata.outputPrefix, versionId)))
+                    complete = false;
+            });
+        pool.run();
+        materializer.printStatistics();
+        if (!complete)
+            llvm::errs() << "Error: not all source trees could be completed\n";
     }
 }
 
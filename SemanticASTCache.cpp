@@ -0,0 +1,74 @@
+#include "SemanticASTCache.h"
+#include "SemanticUtil.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+
+using namespace clang;
+using namespace llvm;
+
+unsigned long ASTCache::estimateSize(ASTUnit& unit) {
+    const ASTContext& astContext = unit.getASTContext();
+    const SourceManager& sm = unit.getSourceManager();
+
+    // The bulk of the memory is taken by the AST nodes and the source buffers.
+    return astContext.getASTAllocatedMemory() + astContext.getSideTableAllocatedMemory()
+        + sm.getContentCacheSize() + sm.getDataStructureSizes();
+}
+
+void ASTCache::evict(unsigned long required) {
+    while (!lru.empty() && memoryInUse + required > memoryBudget) {
+        auto it = units.find(lru.back());
+        logs() << "Evicting AST of: " << it->first << "\n";
+        memoryInUse -= it->second.size;
+        units.erase(it);
+        lru.pop_back();
+    }
+}
+
+ASTUnit* ASTCache::get(const std::string& sourcePath) {
+    // If the AST is cached, mark it as most recently used.
+    auto it = units.find(sourcePath);
+    if (it != units.end()) {
+        lru.splice(lru.begin(), lru, it->second.position);
+        return it->second.unit.get();
+    }
+
+    // Load the snapshot of the translation unit, or parse it.
+    std::unique_ptr<ASTUnit> unit;
+    if (snapshots)
+        unit = snapshots->load(sourcePath);
+    if (unit) {
+        logs() << "Loaded AST snapshot of: " << sourcePath << "\n";
+    } else {
+        logs() << "Building AST of: " << sourcePath << "\n";
+        std::vector<std::unique_ptr<ASTUnit>> ASTs;
+        tooling::ClangTool Tool(compilations, sourcePath);
+        if (Tool.buildASTs(ASTs) != 0 || ASTs.empty())
+        {
+            logs() << "Error building AST of: " << sourcePath << "\n";
+            return nullptr;
+        }
+
+        unit = std::move(ASTs.front());
+        if (snapshots)
+            snapshots->save(sourcePath, *unit);
+    }
+
+    // Make room for the new AST. The new AST is always kept, even if it exceeds the budget on its own.
+    const unsigned long size = estimateSize(*unit);
+    evict(size);
+
+    lru.push_front(sourcePath);
+    Entry& entry = units[sourcePath];
+    entry.unit = std::move(unit);
+    entry.size = size;
+    entry.position = lru.begin();
+    memoryInUse += size;
+
+    return entry.unit.get();
+}
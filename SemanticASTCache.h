@@ -0,0 +1,45 @@
+#ifndef _SEMANTIC_ASTCACHE
+#define _SEMANTIC_ASTCACHE
+
+#include "SemanticSnapshot.h"
+
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+// This class keeps the ASTs of translation units in memory, so they can be rewritten for
+// multiple versions without being parsed again. When the total size of the cached ASTs
+// exceeds the memory budget, the least recently used ASTs are evicted. With a snapshot store, ASTs
+// are loaded from their snapshot when it is up to date, and saved as a snapshot after parsing otherwise.
+class ASTCache {
+    private:
+        struct Entry {
+            std::unique_ptr<clang::ASTUnit> unit;
+            unsigned long size;
+            std::list<std::string>::iterator position;// Position in the LRU list.
+        };
+
+        const clang::tooling::CompilationDatabase& compilations;
+        const unsigned long memoryBudget;// In bytes.
+        ASTSnapshotStore* snapshots;// Null if no snapshots are used.
+        unsigned long memoryInUse;
+        std::list<std::string> lru;// Most recently used translation unit in front.
+        std::map<std::string, Entry> units;
+
+        static unsigned long estimateSize(clang::ASTUnit& unit);
+        void evict(unsigned long required);
+
+    public:
+        ASTCache(const clang::tooling::CompilationDatabase& compilations, unsigned long memoryBudget, ASTSnapshotStore* snapshots = nullptr)
+            : compilations(compilations), memoryBudget(memoryBudget), snapshots(snapshots), memoryInUse(0) {}
+
+        // Get the AST for a source file, parsing it if it isn't cached. Returns nullptr if the
+        // file could not be parsed. The AST stays valid until the next call to get().
+        clang::ASTUnit* get(const std::string& sourcePath);
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "SemanticArchive.h"
+#include "SemanticSerialization.h"
+#include "SemanticUtil.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <ctime>
+#include <sstream>
+
+using namespace llvm;
+
+static const uint32_t PackMagic = 0x4b504d53;// "SMPK"
+static const uint32_t PackIndexMagic = 0x58504d53;// "SMPX"
+static const uint32_t PackFormat = 2;
+
+PackBackend::PackBackend(const std::string& path) : path(path) {
+    const StringRef directory = sys::path::parent_path(path);
+    if (!directory.empty())
+        sys::fs::create_directories(directory);
+
+    SmallString<256> temporary;
+    int FD;
+    if (std::error_code error = sys::fs::createUniqueFile(path + "-%%%%%%.tmp", FD, temporary)) {
+        logs() << "Error creating pack " << path << ": " << error.message() << "\n";
+        return;
+    }
+    temporaryPath = temporary.str();
+    stream.reset(new raw_fd_ostream(FD, /*shouldClose=*/true));
+
+    BinaryWriter header;
+    header.writeU32(PackMagic);
+    header.writeU32(PackFormat);
+    *stream << header.data();
+}
+
+bool PackBackend::write(OutputFile& file) {
+    if (!stream)
+        return false;
+
+    // The file is compressed before taking the lock, so the I/O threads compress in parallel. Files that
+    // don't get smaller are stored as is.
+    PackEntry entry;
+    entry.version = file.version;
+    entry.path = file.relativePath;
+    entry.size = file.contents.size();
+    entry.checksum = 0;
+    entry.compressed = false;
+    entry.checksummed = false;
+    SmallVector<char, 0> compressed;
+    if (zlib::isAvailable()) {
+        entry.checksum = zlib::crc32(file.contents);
+        entry.checksummed = true;
+        if (Error error = zlib::compress(file.contents, compressed))
+            consumeError(std::move(error));
+        else
+            entry.compressed = compressed.size() < file.contents.size();
+    }
+    const StringRef stored = entry.compressed ? StringRef(compressed.data(), compressed.size()) : StringRef(file.contents);
+    entry.storedSize = stored.size();
+
+    std::lock_guard<std::mutex> guard(lock);
+    entry.offset = stream->tell();
+    *stream << stored;
+    index.push_back(std::move(entry));
+    return true;
+}
+
+bool PackBackend::finish() {
+    if (!stream)
+        return false;
+
+    BinaryWriter writer;
+    writer.writeU32(index.size());
+    for (const auto& entry : index) {
+        writer.writeU64(entry.version);
+        writer.writeString(entry.path);
+        writer.writeU64(entry.offset);
+        writer.writeU64(entry.storedSize);
+        writer.writeU64(entry.size);
+        writer.writeU32(entry.checksum);
+        writer.writeBool(entry.compressed);
+        writer.writeBool(entry.checksummed);
+    }
+    writer.writeU64(stream->tell());
+    writer.writeU32(PackIndexMagic);
+    *stream << writer.data();
+
+    stream->close();
+    const bool failed = stream->has_error();
+    stream->clear_error();
+    stream.reset();
+    if (failed || sys::fs::rename(temporaryPath, path)) {
+        logs() << "Error writing pack " << path << "\n";
+        sys::fs::remove(temporaryPath);
+        return false;
+    }
+
+    logs() << "Wrote " << index.size() << " files to " << path << "\n";
+    return true;
+}
+
+bool PackReader::open(const std::string& path) {
+    entries.clear();
+    ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path, -1, /*RequiresNullTerminator=*/false);
+    if (!file) {
+        logs() << "Error reading pack " << path << ": " << file.getError().message() << "\n";
+        return false;
+    }
+    buffer = std::move(*file);
+
+    // The trailer points at the index.
+    const StringRef data = buffer->getBuffer();
+    const size_t trailerSize = sizeof(uint64_t) + sizeof(uint32_t);
+    BinaryReader header(data);
+    if (header.readU32() != PackMagic || header.readU32() != PackFormat || data.size() < 2 * sizeof(uint32_t) + trailerSize) {
+        logs() << "Error reading pack " << path << ": not a pack of format " << PackFormat << "\n";
+        return false;
+    }
+    BinaryReader trailer(data.substr(data.size() - trailerSize));
+    const uint64_t indexOffset = trailer.readU64();
+    if (trailer.readU32() != PackIndexMagic || indexOffset > data.size() - trailerSize) {
+        logs() << "Error reading pack " << path << ": the index is missing\n";
+        return false;
+    }
+
+    BinaryReader reader(data.slice(indexOffset, data.size() - trailerSize));
+    const uint32_t nrOfEntries = reader.readU32();
+    for (uint32_t iii = 0; iii < nrOfEntries && reader.ok(); iii++) {
+        PackEntry entry;
+        entry.version = static_cast<long>(reader.readU64());
+        entry.path = reader.readString();
+        entry.offset = reader.readU64();
+        entry.storedSize = reader.readU64();
+        entry.size = reader.readU64();
+        entry.checksum = reader.readU32();
+        entry.compressed = reader.readBool();
+        entry.checksummed = reader.readBool();
+        if (entry.offset > indexOffset || entry.storedSize > indexOffset - entry.offset)
+            break;
+        entries.push_back(std::move(entry));
+    }
+    if (!reader.ok() || !reader.atEnd() || entries.size() != nrOfEntries) {
+        logs() << "Error reading pack " << path << ": the index is corrupt\n";
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool PackReader::extract(const PackEntry& entry, std::string& contents) const {
+    const StringRef stored = buffer->getBuffer().substr(entry.offset, entry.storedSize);
+    if (!entry.compressed)
+        contents = stored.str();
+    else {
+        SmallVector<char, 0> uncompressed;
+        if (Error error = zlib::uncompress(stored, uncompressed, entry.size)) {
+            logs() << "Error extracting " << entry.path << " of version " << entry.version << ": " << toString(std::move(error)) << "\n";
+            return false;
+        }
+        contents.assign(uncompressed.data(), uncompressed.size());
+    }
+
+    if (contents.size() != entry.size || (entry.checksummed && zlib::isAvailable() && zlib::crc32(contents) != entry.checksum)) {
+        logs() << "Error extracting " << entry.path << " of version " << entry.version << ": the contents are corrupt\n";
+        return false;
+    }
+    return true;
+}
+
+// Write a number as a zero padded octal field of a tar header, which ends with a null character.
+static void writeOctal(char* field, size_t length, uint64_t value) {
+    for (size_t iii = length - 1; iii-- > 0; value >>= 3)
+        field[iii] = '0' + (value & 7);
+    field[length - 1] = '\0';
+}
+
+TarBackend::TarBackend() {
+    // The archive goes to the standard output, everything else that would be printed there goes to the
+    // standard error.
+    outs().flush();
+    const int FD = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    stream.reset(new raw_fd_ostream(FD, /*shouldClose=*/true));
+}
+
+void TarBackend::writeHeader(const std::string& name, uint64_t size, char type) {
+    char header[512];
+    std::memset(header, 0, sizeof(header));
+    std::strncpy(header, name.c_str(), 100);
+    writeOctal(header + 100, 8, 0644);// mode
+    writeOctal(header + 108, 8, 0);// uid
+    writeOctal(header + 116, 8, 0);// gid
+    writeOctal(header + 124, 12, size);
+    writeOctal(header + 136, 12, std::time(nullptr));// mtime
+    header[156] = type;
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+
+    // The checksum is computed with the checksum field filled with spaces.
+    std::memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (size_t iii = 0; iii < sizeof(header); iii++)
+        checksum += static_cast<unsigned char>(header[iii]);
+    writeOctal(header + 148, 7, checksum);
+
+    stream->write(header, sizeof(header));
+}
+
+// Write the padding after an entry of a tar archive, up to the next block.
+static void writePadding(raw_ostream& stream, uint64_t size) {
+    static const char zeros[512] = {};
+    if (size % 512)
+        stream.write(zeros, 512 - size % 512);
+}
+
+bool TarBackend::write(OutputFile& file) {
+    std::string name = file.relativePath;
+    if (file.version != -1) {
+        std::stringstream s;
+        s << "v" << file.version << "/" << file.relativePath;
+        name = s.str();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Names that don't fit in the header are stored in a pax extended header. The length of a record
+    // includes the digits of the length itself.
+    if (name.size() >= 100) {
+        const std::string record = " path=" + name + "\n";
+        size_t length = record.size() + 1;
+        while (std::to_string(length).size() + record.size() != length)
+            length++;
+        const std::string extended = std::to_string(length) + record;
+        writeHeader("././@PaxHeader", extended.size(), 'x');
+        *stream << extended;
+        writePadding(*stream, extended.size());
+    }
+
+    writeHeader(name, file.contents.size(), '0');
+    *stream << file.contents;
+    writePadding(*stream, file.contents.size());
+    return !stream->has_error();
+}
+
+bool TarBackend::finish() {
+    // The archive ends with two empty blocks.
+    static const char zeros[1024] = {};
+    stream->write(zeros, sizeof(zeros));
+    stream->flush();
+    const bool failed = stream->has_error();
+    stream->clear_error();
+    return !failed;
+}
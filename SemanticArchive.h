@@ -0,0 +1,94 @@
+#ifndef _SEMANTIC_ARCHIVE
+#define _SEMANTIC_ARCHIVE
+
+#include "SemanticOutput.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A file in a pack.
+struct PackEntry {
+    long version;// -1 for the files of the whole run
+    std::string path;// The path of the file within its version
+    uint64_t offset;// The offset of the stored contents in the pack
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t checksum;// The crc32 of the contents
+    bool compressed;// Whether the contents are stored compressed with zlib
+    bool checksummed;// Whether the checksum was computed (it needs zlib)
+};
+
+// This backend appends the output files of all versions to a single pack file, instead of creating a
+// directory tree per version. Every file is compressed with zlib (on the I/O thread that writes it),
+// and stored as is when zlib isn't available. The pack starts with a header, followed by the contents
+// of the files. When all files are written, an index is appended that maps every (version, path) to the
+// offset and sizes of its contents, followed by a trailer pointing at the index:
+//
+//   header:  magic "SMPK" (u32), format 2 (u32)
+//   files:   the stored contents of the files, one after the other
+//   index:   number of entries (u32), then per entry: version (u64, -1 for the files of the whole run),
+//            path (string), offset (u64), stored size (u64), size (u64), crc32 of the contents (u32),
+//            compressed (bool), checksummed (bool)
+//   trailer: offset of the index (u64), magic "SMPX" (u32)
+//
+// Integers are little-endian, a u32 of 0x01020304 is stored as the bytes 04 03 02 01. A bool is a single
+// byte (0 or 1). A string is its length (u32) followed by its bytes, without a terminating null. The pack
+// is written to a temporary file, which replaces the pack once the index is written.
+class PackBackend : public OutputBackend {
+    private:
+        const std::string path;
+        std::string temporaryPath;
+        std::unique_ptr<llvm::raw_fd_ostream> stream;
+        std::mutex lock;// Held while appending to the pack
+        std::vector<PackEntry> index;
+
+    public:
+        explicit PackBackend(const std::string& path);
+
+        bool write(OutputFile& file) override;
+        bool finish() override;
+};
+
+// This class reads a pack written by a PackBackend.
+class PackReader {
+    private:
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        std::vector<PackEntry> entries;
+
+    public:
+        // Read a pack and its index. Returns false, and reports the error, if it isn't a valid pack.
+        bool open(const std::string& path);
+
+        // The files in the pack, in the order they were written.
+        const std::vector<PackEntry>& getEntries() const {
+            return entries;
+        }
+
+        // Get the contents of a file. Returns false, and reports the error, if they're corrupt.
+        bool extract(const PackEntry& entry, std::string& contents) const;
+};
+
+// This backend streams the output files as an (uncompressed) tar archive to the standard output, so they
+// can be piped into other tools. Every file is stored as vN/<path>. The messages that are normally
+// printed on the standard output go to the standard error instead.
+class TarBackend : public OutputBackend {
+    private:
+        std::unique_ptr<llvm::raw_fd_ostream> stream;
+        std::mutex lock;// Held while appending to the archive
+
+        void writeHeader(const std::string& name, uint64_t size, char type);
+
+    public:
+        TarBackend();
+
+        bool write(OutputFile& file) override;
+        bool finish() override;
+};
+
+#endif
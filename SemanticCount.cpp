@@ -0,0 +1,145 @@
+#include "SemanticCount.h"
+
+#include <algorithm>
+#include <cmath>
+
+VersionCount::VersionCount(uint64_t value) {
+    while (value) {
+        limbs.push_back((uint32_t)value);
+        value >>= 32;
+    }
+}
+
+VersionCount VersionCount::fromLimbs(const std::vector<uint32_t>& limbs) {
+    VersionCount value;
+    value.limbs = limbs;
+    value.trim();
+    return value;
+}
+
+void VersionCount::trim() {
+    while (!limbs.empty() && limbs.back() == 0)
+        limbs.pop_back();
+}
+
+uint64_t VersionCount::toUInt64() const {
+    if (!fitsIn64())
+        return UINT64_MAX;
+
+    uint64_t value = 0;
+    for (size_t iii = limbs.size(); iii > 0; iii--)
+        value = (value << 32) | limbs[iii - 1];
+    return value;
+}
+
+unsigned VersionCount::bitLength() const {
+    if (isZero())
+        return 0;
+
+    unsigned bits = 32 * (limbs.size() - 1);
+    for (uint32_t top = limbs.back(); top; top >>= 1)
+        bits++;
+    return bits;
+}
+
+VersionCount& VersionCount::operator+= (const VersionCount& other) {
+    limbs.resize(std::max(limbs.size(), other.limbs.size()) + 1, 0);
+    uint64_t carry = 0;
+    for (size_t iii = 0; iii < limbs.size(); iii++) {
+        const uint64_t sum = (uint64_t)limbs[iii] + (iii < other.limbs.size() ? other.limbs[iii] : 0) + carry;
+        limbs[iii] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+    trim();
+    return *this;
+}
+
+VersionCount& VersionCount::operator-= (const VersionCount& other) {
+    int64_t borrow = 0;
+    for (size_t iii = 0; iii < limbs.size(); iii++) {
+        int64_t difference = (int64_t)limbs[iii] - (iii < other.limbs.size() ? other.limbs[iii] : 0) - borrow;
+        borrow = (difference < 0) ? 1 : 0;
+        limbs[iii] = (uint32_t)(difference + (borrow << 32));
+    }
+    trim();
+    return *this;
+}
+
+VersionCount& VersionCount::operator*= (uint32_t factor) {
+    uint64_t carry = 0;
+    for (auto& limb : limbs) {
+        const uint64_t product = (uint64_t)limb * factor + carry;
+        limb = (uint32_t)product;
+        carry = product >> 32;
+    }
+    if (carry)
+        limbs.push_back((uint32_t)carry);
+    trim();
+    return *this;
+}
+
+uint32_t VersionCount::divide(uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (size_t iii = limbs.size(); iii > 0; iii--) {
+        const uint64_t current = (remainder << 32) | limbs[iii - 1];
+        limbs[iii - 1] = (uint32_t)(current / divisor);
+        remainder = current % divisor;
+    }
+    trim();
+    return (uint32_t)remainder;
+}
+
+VersionCount VersionCount::scale(uint64_t value) const {
+    // Multiply by both halves of the value, and drop the two least significant limbs.
+    VersionCount low = *this;
+    low *= (uint32_t)value;
+    VersionCount high = *this;
+    high *= (uint32_t)(value >> 32);
+    high.limbs.insert(high.limbs.begin(), 0);
+    high.trim();
+    high += low;
+
+    VersionCount result;
+    if (high.limbs.size() > 2)
+        result.limbs.assign(high.limbs.begin() + 2, high.limbs.end());
+    return result;
+}
+
+int VersionCount::compare(const VersionCount& other) const {
+    if (limbs.size() != other.limbs.size())
+        return (limbs.size() < other.limbs.size()) ? -1 : 1;
+
+    for (size_t iii = limbs.size(); iii > 0; iii--) {
+        if (limbs[iii - 1] != other.limbs[iii - 1])
+            return (limbs[iii - 1] < other.limbs[iii - 1]) ? -1 : 1;
+    }
+    return 0;
+}
+
+double VersionCount::log2() const {
+    if (fitsIn64())
+        return std::log2((double)toUInt64());
+
+    // Only the three most significant limbs matter for the precision of a double.
+    const size_t size = limbs.size();
+    const double top = ((double)limbs[size - 1] * 4294967296.0 + limbs[size - 2]) * 4294967296.0 + limbs[size - 3];
+    return std::log2(top) + 32.0 * (size - 3);
+}
+
+std::string VersionCount::toString() const {
+    if (isZero())
+        return "0";
+
+    // Extract groups of nine decimal digits.
+    VersionCount value = *this;
+    std::vector<uint32_t> groups;
+    while (!value.isZero())
+        groups.push_back(value.divide(1000000000u));
+
+    std::string result = std::to_string(groups.back());
+    for (size_t iii = groups.size() - 1; iii > 0; iii--) {
+        std::string group = std::to_string(groups[iii - 1]);
+        result += std::string(9 - group.size(), '0') + group;
+    }
+    return result;
+}
@@ -0,0 +1,62 @@
+#ifndef _SEMANTIC_COUNT
+#define _SEMANTIC_COUNT
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// This class represents an arbitrary-precision unsigned integer, used to count versions. The number
+// of reorderings of a struct grows with the factorial of its number of fields, which overflows 64 bits
+// starting from 21 fields.
+class VersionCount {
+    private:
+        std::vector<uint32_t> limbs;// Least significant limb first, without leading zero limbs
+
+        void trim();
+
+    public:
+        VersionCount(uint64_t value = 0);
+
+        // Construct a value from its limbs of 32 bits, least significant limb first.
+        static VersionCount fromLimbs(const std::vector<uint32_t>& limbs);
+
+        bool isZero() const {
+            return limbs.empty();
+        }
+
+        // Whether the value fits in 64 bits, and the value itself (saturated to UINT64_MAX if it doesn't fit).
+        bool fitsIn64() const {
+            return limbs.size() <= 2;
+        }
+        uint64_t toUInt64() const;
+
+        // The number of bits needed to represent the value.
+        unsigned bitLength() const;
+
+        VersionCount& operator+= (const VersionCount& other);
+        VersionCount& operator-= (const VersionCount& other);// Requires other <= *this
+        VersionCount& operator*= (uint32_t factor);
+
+        // Divide by a small divisor in place, and return the remainder.
+        uint32_t divide(uint32_t divisor);
+
+        // Compute floor(*this * value / 2^64). For values < 2^64 this maps [0, 2^64) monotonically onto [0, *this).
+        VersionCount scale(uint64_t value) const;
+
+        // Returns -1, 0 or 1 if this is less than, equal to or greater than the other value.
+        int compare(const VersionCount& other) const;
+
+        double log2() const;
+        std::string toString() const;
+};
+
+inline VersionCount operator+ (VersionCount left, const VersionCount& right) { return left += right; }
+inline VersionCount operator- (VersionCount left, const VersionCount& right) { return left -= right; }
+inline bool operator== (const VersionCount& left, const VersionCount& right) { return left.compare(right) == 0; }
+inline bool operator!= (const VersionCount& left, const VersionCount& right) { return left.compare(right) != 0; }
+inline bool operator< (const VersionCount& left, const VersionCount& right) { return left.compare(right) < 0; }
+inline bool operator<= (const VersionCount& left, const VersionCount& right) { return left.compare(right) <= 0; }
+inline bool operator> (const VersionCount& left, const VersionCount& right) { return left.compare(right) > 0; }
+inline bool operator>= (const VersionCount& left, const VersionCount& right) { return left.compare(right) >= 0; }
+
+#endif
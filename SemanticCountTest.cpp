@@ -0,0 +1,70 @@
+// Test of the arbitrary-precision version counts. Every case computes a value that needs more than 64 bits
+// (or crosses the boundary), and compares it with the expected value.
+
+#include "SemanticCount.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+using namespace llvm;
+
+// Check a single value, and report whether it is the expected one.
+static bool check(const std::string& name, const VersionCount& value, const std::string& expected) {
+    outs() << name << ": " << value.toString() << "\n";
+    if (value.toString() != expected) {
+        errs() << name << ": expected " << expected << "\n";
+        return false;
+    }
+    return true;
+}
+
+static bool check(const std::string& name, bool condition) {
+    outs() << name << ": " << (condition ? "ok" : "failed") << "\n";
+    return condition;
+}
+
+int main() {
+    bool success = true;
+
+    // Addition and subtraction carry and borrow across the 64-bit boundary.
+    const VersionCount twoTo64 = VersionCount(UINT64_MAX) + VersionCount(1);
+    success = check("2^64", twoTo64, "18446744073709551616") && success;
+    success = check("2^64 limbs", twoTo64 == VersionCount::fromLimbs({0, 0, 1}) && !twoTo64.fitsIn64() && twoTo64.bitLength() == 65) && success;
+    success = check("2^64 - 1", twoTo64 - VersionCount(1), "18446744073709551615") && success;
+    success = check("2^64 - 1 fits", (twoTo64 - VersionCount(1)).fitsIn64() && (twoTo64 - VersionCount(1)).toUInt64() == UINT64_MAX) && success;
+    success = check("saturated", twoTo64.toUInt64() == UINT64_MAX) && success;
+
+    // The number of orderings of 21 fields is the first factorial that doesn't fit in 64 bits.
+    VersionCount factorial(1);
+    for (uint32_t iii = 2; iii <= 21; iii++)
+        factorial *= iii;
+    success = check("21!", factorial, "51090942171709440000") && success;
+    for (uint32_t iii = 22; iii <= 30; iii++)
+        factorial *= iii;
+    success = check("30!", factorial, "265252859812191058636308480000000") && success;
+    success = check("30! + 30!", factorial + factorial, "530505719624382117272616960000000") && success;
+
+    // Dividing 30! by 30, 29, ..., 2 gives 1 again, without remainders.
+    VersionCount quotient = factorial;
+    bool exact = true;
+    for (uint32_t iii = 30; iii >= 2; iii--)
+        exact = (quotient.divide(iii) == 0) && exact;
+    success = check("30! / 30!", exact && quotient == VersionCount(1)) && success;
+
+    VersionCount remainder = twoTo64;
+    success = check("2^64 % 10", remainder.divide(10) == 6 && remainder.toString() == "1844674407370955161") && success;
+
+    // Scaling maps [0, 2^64) onto [0, value).
+    success = check("scale 0", factorial.scale(0), "0") && success;
+    success = check("scale 2^63", factorial.scale((uint64_t)1 << 63), "132626429906095529318154240000000") && success;
+    success = check("scale max", factorial.scale(UINT64_MAX) < factorial) && success;
+
+    // Comparisons look at the length before the limbs.
+    success = check("compare", VersionCount(UINT64_MAX) < twoTo64 && twoTo64 > VersionCount(UINT64_MAX) && factorial >= factorial) && success;
+    success = check("log2", std::fabs(twoTo64.log2() - 64.0) < 1e-9) && success;
+
+    return success ? 0 : 1;
+}
@@ -1,14 +1,20 @@
 #ifndef _SEMANTIC_DATA
 #define _SEMANTIC_DATA
 
+#include "SemanticRandom.h"
+#include "SemanticSampler.h"
+#include "SemanticSerialization.h"
+#include "SemanticSplicing.h"
 #include "SemanticUtil.h"
 
 #include "llvm/ADT/MapVector.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
 
 #include "json.h"
 
 #include <numeric>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -25,6 +31,7 @@ class TargetUnique {
             : name(name), fileName(fileName), global(global) {}
         std::string getName() const { return name;}
         std::string getFileName() const { return fileName;}
+        bool isGlobal() const { return global;}
         bool operator== (const TargetUnique& other) const
         {
             // If the names differ, it can't be the same
@@ -41,13 +48,15 @@ class TargetUnique {
 
             return true;
         }
+        // A string representation that is equal for targets that are the same
+        std::string getIdentity() const
+        {
+            return global ? name : name + ":" + fileName;
+        }
         bool operator< (const TargetUnique& other) const
         {
             // Create string representations so we can correctly compare
-            std::string left = global ? name : name + ":" + fileName;
-            std::string right = other.global ? other.name : other.name + ":" + other.fileName;
-
-            return left < right;
+            return getIdentity() < other.getIdentity();
         }
 
         // This class describes the data associated to a target
@@ -56,11 +65,48 @@ class TargetUnique {
                 virtual ~Data() {}
             public:
                 bool valid;
+                std::string reason;// The reason the target was invalidated
+                std::set<std::string> translationUnits;// The main files of the translation units the target occurs in
+                std::set<SourceSite> sites;// The sites in the source code that are rewritten for the target
+                bool spliceable;// Whether all sites could be recorded, so versions can be generated by splicing
 
-                Data(bool valid = true) : valid(valid) {}
+                Data(bool valid = true) : valid(valid), spliceable(true) {}
+
+                // Merge the data found for the same target in another translation unit. Invalid wins.
+                virtual void merge(const Data& other)
+                {
+                    if (valid && !other.valid)
+                        reason = other.reason;
+                    valid = valid && other.valid;
+                    spliceable = spliceable && other.spliceable;
+                    translationUnits.insert(other.translationUnits.begin(), other.translationUnits.end());
+                    sites.insert(other.sites.begin(), other.sites.end());
+                }
                 virtual bool empty() const = 0;
                 virtual Json::Value getJSON(const std::vector<unsigned>& ordering) const = 0;
                 virtual unsigned nrOfItems() const = 0;
+
+                // Write the data to, or read it back from a candidate database. Subclasses add their items.
+                virtual void serialize(BinaryWriter& writer) const
+                {
+                    writer.writeBool(valid);
+                    writer.writeString(reason);
+                    writer.writeBool(spliceable);
+                    writer.writeStrings(translationUnits);
+                    writer.writeU32(sites.size());
+                    for (const auto& site : sites)
+                        site.serialize(writer);
+                }
+                virtual void deserialize(BinaryReader& reader)
+                {
+                    valid = reader.readBool();
+                    reason = reader.readString();
+                    spliceable = reader.readBool();
+                    translationUnits = reader.readStrings();
+                    const uint32_t nrOfSites = reader.readU32();
+                    for (uint32_t iii = 0; iii < nrOfSites && reader.ok(); iii++)
+                        sites.insert(SourceSite::deserialize(reader));
+                }
         };
 };
 
@@ -74,19 +120,35 @@ class Transformation {
 
         Transformation(const TargetUnique& target)
             : target(target) {}
-        static void calculateStatistics(const std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>>& candidates, std::map<unsigned, unsigned>& histogram, unsigned long& totalItems, unsigned long& totalVersions) {}
+        static void calculateStatistics(const std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>>& candidates, std::map<unsigned, unsigned>& histogram, unsigned long& totalItems, VersionCount& totalVersions) {}
         virtual Json::Value getJSON(const TargetUnique::Data& data) const = 0;
 
+        // Compute the edits that apply the transformation to a site. Returns false if the site doesn't fit the
+        // transformation, the version then has to be rewritten by clang.
+        virtual bool splice(const SourceSite& site, std::vector<SourceEdit>& edits) const = 0;
+
         bool operator== (const Transformation& other) const
         {
             return (target == other.target);
         }
 
+        // A 64-bit hash of the target and the transformation-specific choice. Equal transformations
+        // have equal fingerprints, so the fingerprints can be used to detect duplicates.
+        virtual uint64_t fingerprint() const = 0;
+
+        // Combine the hash of the target with the transformation-specific values.
+        uint64_t fingerprint(const std::vector<unsigned>& values) const
+        {
+            std::vector<uint64_t> buffer(1, llvm::xxHash64(target.getIdentity()));
+            buffer.insert(buffer.end(), values.begin(), values.end());
+            return llvm::xxHash64(llvm::StringRef(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(uint64_t)));
+        }
+
         void outputDebugInfo() const
         {
-            llvm::outs() << "Chosen target: " << target.getName() << "\n";
+            logs() << "Chosen target: " << target.getName() << "\n";
             outputTransformationSpecificDebugInfo();
-            llvm::outs() << "\n";
+            logs() << "\n";
         }
 };
 
@@ -94,27 +156,42 @@ class InsertionTransformation : public Transformation {
     protected:
         virtual void outputTransformationSpecificDebugInfo() const
         {
-            llvm::outs() << "Chosen insertion point: " << insertionPoint << "\n";
+            logs() << "Chosen insertion point: " << insertionPoint << "\n";
         }
 
     public:
         const unsigned insertionPoint;
 
-        InsertionTransformation(const TargetUnique& target, const TargetUnique::Data& data)
-            : Transformation(target), insertionPoint(random_0_to_n(data.nrOfItems())) {}
+        InsertionTransformation(const TargetUnique& target, const TargetUnique::Data& data, RandomStream& random)
+            : Transformation(target), insertionPoint(random.random_0_to_n(data.nrOfItems())) {}
+
+        // Construct the version of the target with the given rank, in [0, versionCount(data)).
+        InsertionTransformation(const TargetUnique& target, const TargetUnique::Data& data, const VersionCount& rank)
+            : Transformation(target), insertionPoint(rank.toUInt64()) {}
 
         bool operator== (const InsertionTransformation& other) const
         {
             return (static_cast<const Transformation&>(*this) == static_cast<const Transformation&>(other)) && (insertionPoint == other.insertionPoint);
         }
 
-        static void calculateStatistics(const std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>>& candidates, std::map<unsigned, unsigned>& histogram, unsigned long& totalItems, unsigned long& totalVersions)
+        virtual uint64_t fingerprint() const
+        {
+            return Transformation::fingerprint(std::vector<unsigned>(1, insertionPoint));
+        }
+
+        // The new item can be inserted before every item, or after the last one.
+        static VersionCount versionCount(const TargetUnique::Data& data)
+        {
+            return VersionCount(data.nrOfItems()) + 1;
+        }
+
+        static void calculateStatistics(const std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>>& candidates, std::map<unsigned, unsigned>& histogram, unsigned long& totalItems, VersionCount& totalVersions)
         {
             for (const auto& candidate : candidates) {
                 unsigned nrOfItems = candidate.second.nrOfItems();
 
                 // Keep count of the total possible reorderings and the average number of items
-                totalVersions += nrOfItems +1;
+                totalVersions += versionCount(candidate.second);
                 totalItems += nrOfItems;
 
                 // Look if this amount has already occured or not.
@@ -135,36 +212,68 @@ class InsertionTransformation : public Transformation {
 
             return output;
         }
+
+        virtual bool splice(const SourceSite& site, std::vector<SourceEdit>& edits) const
+        {
+            if (site.slices.empty())
+                return false;
+
+            // Insert the new item before the slice at the insertion point, or after the last slice.
+            if (insertionPoint < site.slices.size()) {
+                const SourceSlice& slice = site.slices[insertionPoint];
+                edits.emplace_back(slice.offset, slice.length, site.newItem + site.separatorBefore + slice.text);
+            } else {
+                const SourceSlice& slice = site.slices.back();
+                edits.emplace_back(slice.offset, slice.length, slice.text + site.separatorAfter + site.newItem);
+            }
+            return true;
+        }
 };
 
 class ReorderingTransformation : public Transformation {
     protected:
         virtual void outputTransformationSpecificDebugInfo() const
         {
-            llvm::outs() << "Chosen ordering: " << "\n";
+            logs() << "Chosen ordering: " << "\n";
             for (auto it : ordering) {
-                llvm::outs() << it << " ";
+                logs() << it << " ";
             }
         }
 
     public:
         const std::vector<unsigned> ordering;
 
-        ReorderingTransformation(const TargetUnique& target, const TargetUnique::Data& data)
-            : Transformation(target), ordering(generate_random_ordering(data.nrOfItems())) {}
+        ReorderingTransformation(const TargetUnique& target, const TargetUnique::Data& data, RandomStream& random)
+            : Transformation(target), ordering(random.random_ordering(data.nrOfItems())) {}
+
+        // Construct the version of the target with the given rank, in [0, versionCount(data)). The
+        // original ordering has no version, so we skip the permutation with rank 0.
+        ReorderingTransformation(const TargetUnique& target, const TargetUnique::Data& data, const VersionCount& rank)
+            : Transformation(target), ordering(unrank_permutation(data.nrOfItems(), rank + 1)) {}
 
         bool operator== (const ReorderingTransformation& other) const
         {
             return (static_cast<const Transformation&>(*this) == static_cast<const Transformation&>(other)) && (ordering == other.ordering);
         }
 
-        static void calculateStatistics(const std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>>& candidates, std::map<unsigned, unsigned>& histogram, unsigned long& totalItems, unsigned long& totalVersions)
+        virtual uint64_t fingerprint() const
+        {
+            return Transformation::fingerprint(ordering);
+        }
+
+        // All permutations are possible reorderings, except for the original one.
+        static VersionCount versionCount(const TargetUnique::Data& data)
+        {
+            return factorial(data.nrOfItems()) - 1;
+        }
+
+        static void calculateStatistics(const std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>>& candidates, std::map<unsigned, unsigned>& histogram, unsigned long& totalItems, VersionCount& totalVersions)
         {
             for (const auto& candidate : candidates) {
                 unsigned nrOfItems = candidate.second.nrOfItems();
 
                 // Keep count of the total possible reorderings and the average number of items
-                totalVersions += factorial(nrOfItems) -1;// All permutations are possible reorderings, except for the original one.
+                totalVersions += versionCount(candidate.second);
                 totalItems += nrOfItems;
 
                 // Look if this amount has already occured or not.
@@ -190,6 +299,19 @@ class ReorderingTransformation : public Transformation {
 
             return output;
         }
+
+        virtual bool splice(const SourceSite& site, std::vector<SourceEdit>& edits) const
+        {
+            if (site.slices.size() != ordering.size())
+                return false;
+
+            // Every slice takes the place of another one based on the ordering.
+            for (unsigned iii = 0; iii < ordering.size(); iii++) {
+                const SourceSlice& slice = site.slices[iii];
+                edits.emplace_back(slice.offset, slice.length, site.slices[ordering[iii]].text);
+            }
+            return true;
+        }
 };
 
 // This class contains the data used during the generating of new versions
@@ -197,26 +319,86 @@ template <typename TargetType>
 class Candidates {
     private:
         llvm::MapVector<TargetType, typename TargetType::Data, std::map<TargetType, unsigned>> candidates;// Map containing all information regarding candidates.
+        llvm::raw_ostream& logStream;// Stream that receives the messages of the analysis.
+        std::set<std::string> dependencies;// The files the analysed translation units depend on.
 
     public:
+        explicit Candidates(llvm::raw_ostream& logStream = llvm::outs()) : logStream(logStream) {}
+
+        llvm::raw_ostream& log() {
+            return logStream;
+        }
+
         typename TargetType::Data& get(const TargetType& candidate) {
             return candidates[candidate];
         }
 
+        void addTranslationUnit(const TargetType& candidate, const std::string& translationUnit) {
+            candidates[candidate].translationUnits.insert(translationUnit);
+        }
+
+        void addSite(const TargetType& candidate, const SourceSite& site) {
+            candidates[candidate].sites.insert(site);
+        }
+
+        void setUnspliceable(const TargetType& candidate) {
+            candidates[candidate].spliceable = false;
+        }
+
         void invalidate(const TargetType& candidate, const std::string& reason) {
             // If the candidate is already invalid, just return
             TargetUnique::Data& data = candidates[candidate];
             if (!data.valid)
                 return;
 
-            llvm::outs() << "Invalidate candidate: " << candidate.getName() << ". Reason: " << reason << ".\n";
+            logStream << "Invalidate candidate: " << candidate.getName() << ". Reason: " << reason << ".\n";
             data.valid = false;
+            data.reason = reason;
+        }
+
+        void addDependency(const std::string& fileName) {
+            dependencies.insert(fileName);
+        }
+
+        const std::set<std::string>& getDependencies() const {
+            return dependencies;
+        }
+
+        // Merge the candidates found in another table into this one. The targets are merged in the order
+        // in which the other table encountered them, so merging tables in a fixed order gives a fixed result.
+        void merge(const Candidates& other) {
+            for (const auto& it : other.candidates)
+                candidates[it.first].merge(it.second);
+            dependencies.insert(other.dependencies.begin(), other.dependencies.end());
+        }
+
+        // Write the candidates to, or read them back from a candidate database. The candidates are
+        // written in the order in which they were encountered, so merging stays deterministic.
+        void serialize(BinaryWriter& writer) const {
+            writer.writeU32(candidates.size());
+            for (const auto& it : candidates) {
+                writer.writeString(it.first.getName());
+                writer.writeString(it.first.getFileName());
+                writer.writeBool(it.first.isGlobal());
+                it.second.serialize(writer);
+            }
+        }
+        bool deserialize(BinaryReader& reader) {
+            const uint32_t nrOfCandidates = reader.readU32();
+            for (uint32_t iii = 0; iii < nrOfCandidates && reader.ok(); iii++) {
+                const std::string name = reader.readString();
+                const std::string fileName = reader.readString();
+                const bool global = reader.readBool();
+                candidates[TargetType(name, fileName, global)].deserialize(reader);
+            }
+            return reader.ok();
         }
 
         std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>> select_valid() const {
             std::vector<std::pair<const TargetUnique&, const TargetUnique::Data&>> ret;
             for (const auto& it : candidates) {
-                if (it.second.valid)
+                // Targets that were only encountered as a use, but never as a candidate, are skipped
+                if (it.second.valid && !it.second.empty())
                 {
                     llvm::outs() << "Valid candidate: " << it.first.getName() << "\n";
                     ret.emplace_back(it);
@@ -234,4 +416,51 @@ class MetaData {
         MetaData(const std::string& bd, const std::string& od) : baseDirectory(bd), outputPrefix(od + "version_") {}
 };
 
+// This class contains the options that determine how versions are generated
+class GenerationOptions {
+    public:
+        enum SamplingPolicy {
+            UniformSampling,// Choose a candidate and a version uniformly, and retry when it's a duplicate
+            UnrankSampling,// Map the version id onto a distinct version of all candidates
+            EnumerateSampling,// Walk all versions of all candidates
+            WeightedSampling,// Choose a candidate weighted by its number of remaining versions, and one of those versions
+        };
+
+        enum OutputBackendKind {
+            DirectoryOutput,// Write every file with plain system calls
+            IOUringOutput,// Write the files in batches through io_uring, if it's available
+            PackOutput,// Append the files of all versions to a single, compressed pack file
+            TarOutput,// Stream the files of all versions as a tar archive to the standard output
+            GitOutput,// Store the files as objects in a bare git repository, with a branch per version
+        };
+
+        bool reuseASTs;// Parse every translation unit once and rewrite all versions from cached ASTs
+        unsigned long astMemoryBudget;// Memory budget (in bytes) for the cached ASTs of all jobs together
+        std::string astSnapshotDirectory;// Directory in which serialized ASTs are kept across runs, empty means none
+        unsigned long astSnapshotCapacity;// The maximum size (in bytes) of the AST snapshots
+        bool fusedRewrite;// Generate a batch of versions from a single traversal of every translation unit
+        unsigned long batchSize;// Number of versions in a batch, 0 means all versions
+        bool splice;// Generate versions by splicing the source ranges recorded during analysis, without invoking clang
+
+        bool reusePreambles;// Parse the headers included by a translation unit once, into a precompiled preamble
+        bool analysisCache;// Read the results of the analysis from the candidate database in the output directory, if it's up to date
+
+        unsigned jobs;// Number of threads used to analyse translation units and generate versions
+        unsigned seed;// The seed of the random streams of the versions
+        SamplingPolicy sampling;// How the versions are chosen
+        double saturation;// Enumerate the versions instead of unranking them when this fraction of all versions (or more) is requested, 0 disables this
+        bool shuffleEnumeration;// Enumerate the versions in the order of a seeded permutation, instead of in order
+        unsigned long window;// Number of versions in a window of phase 2 without batch size
+
+        bool patch;// Write a single patch per version instead of the rewritten files
+        bool materialize;// Complete the version directories with the unmodified files of the base directory
+        bool vfsOverlay;// Write a VFS overlay of the rewritten files and a compilation database using it per version
+        OutputBackendKind outputBackend;// How the output files are written
+        unsigned outputThreads;// Number of threads writing the output files in the background, 0 writes them inline
+        unsigned long maxInFlightOutput;// The maximum size (in bytes) of the output files waiting to be written
+
+        GenerationOptions() : reuseASTs(false), astMemoryBudget(0), astSnapshotCapacity(0), fusedRewrite(false), batchSize(0), splice(false), reusePreambles(false), analysisCache(false), jobs(1), seed(0), sampling(UnrankSampling),
+            saturation(0), shuffleEnumeration(true), window(1024), patch(false), materialize(false), vfsOverlay(false), outputBackend(DirectoryOutput), outputThreads(0), maxInFlightOutput(0) {}
+};
+
 #endif
@@ -0,0 +1,156 @@
+#include "SemanticDatabase.h"
+#include "SemanticSerialization.h"
+
+#include "clang/Basic/Version.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+
+static const uint32_t DatabaseMagic = 0x42444d53;// "SMDB"
+static const uint32_t DatabaseFormat = 1;
+
+bool CandidateDatabase::load() {
+    units.clear();
+
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+        return false;
+
+    BinaryReader reader((*buffer)->getBuffer());
+    if (reader.readU32() != DatabaseMagic || reader.readU32() != DatabaseFormat || reader.readU64() != configurationHash)
+        return false;
+
+    const uint32_t nrOfUnits = reader.readU32();
+    for (uint32_t iii = 0; iii < nrOfUnits && reader.ok(); iii++) {
+        const std::string sourcePath = reader.readString();
+        Unit& unit = units[sourcePath];
+        unit.commandHash = reader.readU64();
+        const uint32_t nrOfDependencies = reader.readU32();
+        for (uint32_t jjj = 0; jjj < nrOfDependencies && reader.ok(); jjj++) {
+            const std::string dependency = reader.readString();
+            unit.dependencies[dependency] = reader.readU64();
+        }
+        unit.table = reader.readString();
+    }
+
+    if (!reader.ok() || !reader.atEnd()) {
+        units.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CandidateDatabase::save() const {
+    BinaryWriter writer;
+    writer.writeU32(DatabaseMagic);
+    writer.writeU32(DatabaseFormat);
+    writer.writeU64(configurationHash);
+    writer.writeU32(units.size());
+    for (const auto& it : units) {
+        writer.writeString(it.first);
+        writer.writeU64(it.second.commandHash);
+        writer.writeU32(it.second.dependencies.size());
+        for (const auto& dependency : it.second.dependencies) {
+            writer.writeString(dependency.first);
+            writer.writeU64(dependency.second);
+        }
+        writer.writeString(it.second.table);
+    }
+
+    // Write to a temporary file first, so an interrupted run doesn't leave a truncated database behind.
+    sys::fs::create_directories(sys::path::parent_path(path));
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::error_code error;
+        raw_fd_ostream stream(temporaryPath, error, sys::fs::F_None);
+        if (error) {
+            errs() << "Could not write candidate database " << temporaryPath << ": " << error.message() << "\n";
+            return false;
+        }
+        stream << writer.data();
+    }
+
+    if (std::error_code error = sys::fs::rename(temporaryPath, path)) {
+        errs() << "Could not write candidate database " << path << ": " << error.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+const CandidateDatabase::Unit* CandidateDatabase::lookup(const std::string& sourcePath, uint64_t commandHash) const {
+    auto it = units.find(sourcePath);
+    if (it == units.end() || it->second.commandHash != commandHash)
+        return nullptr;
+
+    // Every file the translation unit included must still have the same contents.
+    for (const auto& dependency : it->second.dependencies) {
+        uint64_t hash;
+        if (!hashFile(dependency.first, hash) || hash != dependency.second)
+            return nullptr;
+    }
+    return &it->second;
+}
+
+bool ContentHashes::get(const std::string& fileName, uint64_t& hash) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = hashes.find(fileName);
+        if (it != hashes.end()) {
+            hash = it->second;
+            return true;
+        }
+    }
+
+    // The file is hashed outside of the lock, so other files can be hashed concurrently.
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(fileName);
+    if (!buffer)
+        return false;
+
+    hash = xxHash64((*buffer)->getBuffer());
+    std::lock_guard<std::mutex> guard(lock);
+    hashes[fileName] = hash;
+    return true;
+}
+
+// Identify the build of the tool by the size and modification time of its executable. The version of clang
+// doesn't change when the tool itself is rebuilt.
+static void writeBuildIdentifier(BinaryWriter& writer) {
+    static int anchor;
+    sys::fs::file_status status;
+    const std::string executable = sys::fs::getMainExecutable("semantic-mod", &anchor);
+    if (executable.empty() || sys::fs::status(executable, status)) {
+        writer.writeString("");
+        return;
+    }
+
+    writer.writeString(executable);
+    writer.writeU64(status.getSize());
+    writer.writeU64(sys::toTimeT(status.getLastModificationTime()));
+}
+
+uint64_t CandidateDatabase::hashConfiguration(const std::string& kind, const std::string& baseDirectory) {
+    BinaryWriter writer;
+    writer.writeU32(DatabaseFormat);
+    writer.writeString(clang::getClangFullVersion());
+    writeBuildIdentifier(writer);
+    writer.writeString(kind);
+    writer.writeString(baseDirectory);
+    return xxHash64(writer.data());
+}
+
+uint64_t CandidateDatabase::hashCompileCommands(const clang::tooling::CompilationDatabase& compilations, const std::string& sourcePath) {
+    BinaryWriter writer;
+    for (const auto& command : compilations.getCompileCommands(sourcePath)) {
+        writer.writeString(command.Directory);
+        writer.writeString(command.Filename);
+        writer.writeU32(command.CommandLine.size());
+        for (const auto& argument : command.CommandLine)
+            writer.writeString(argument);
+    }
+    return xxHash64(writer.data());
+}
@@ -0,0 +1,92 @@
+#ifndef _SEMANTIC_DATABASE
+#define _SEMANTIC_DATABASE
+
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// This class hashes the contents of files. Headers are shared by many translation units, so every file
+// is only hashed once. It can be used by multiple threads.
+class ContentHashes {
+    private:
+        std::mutex lock;
+        std::map<std::string, uint64_t> hashes;
+
+    public:
+        // Hash the content of a file. Returns false if the file can't be read.
+        bool get(const std::string& fileName, uint64_t& hash);
+};
+
+// This class stores the results of the analysis phase in a compact binary file, so later runs on the
+// same sources don't have to analyse them again. Every translation unit has its own entry, containing
+// its serialized candidates table and everything the table depends on: the compile commands of the
+// translation unit and the content hashes of all files it included. The file as a whole is tied to the
+// version of clang, the build of the tool (a rebuilt tool may analyse differently), the kind of targets
+// and the base directory.
+class CandidateDatabase {
+    public:
+        struct Unit {
+            uint64_t commandHash;// Hash of the compile commands of the translation unit
+            std::map<std::string, uint64_t> dependencies;// Content hash of every file the translation unit depends on
+            std::string table;// The serialized candidates table of the translation unit
+        };
+
+    private:
+        const std::string path;
+        const uint64_t configurationHash;
+        std::map<std::string, Unit> units;// The entries, by source path
+        mutable ContentHashes fileHashes;// The content hashes computed during this run
+
+    public:
+        CandidateDatabase(const std::string& path, uint64_t configurationHash)
+            : path(path), configurationHash(configurationHash) {}
+
+        // Read the database from disk. Returns false (and leaves the database empty) if there is
+        // no database, or it's corrupt or was written by another configuration.
+        bool load();
+
+        // Write the database to disk. The file is replaced atomically.
+        bool save() const;
+
+        // Get the entry of a translation unit if it's still up to date, nullptr otherwise.
+        const Unit* lookup(const std::string& sourcePath, uint64_t commandHash) const;
+
+        // Add or replace the entry of a translation unit. Returns false (and removes the entry) if a dependency
+        // couldn't be hashed, in which case the dependency is set.
+        template <typename DependencyRange>
+        bool store(const std::string& sourcePath, uint64_t commandHash, const DependencyRange& dependencies, const std::string& table, std::string& missing) {
+            Unit unit;
+            unit.commandHash = commandHash;
+            unit.table = table;
+            for (const auto& dependency : dependencies) {
+                if (!hashFile(dependency, unit.dependencies[dependency])) {
+                    units.erase(sourcePath);
+                    missing = dependency;
+                    return false;
+                }
+            }
+            units[sourcePath] = std::move(unit);
+            return true;
+        }
+
+        size_t size() const {
+            return units.size();
+        }
+
+        const std::string& getPath() const {
+            return path;
+        }
+
+        // Hash the content of a file. Returns false if the file can't be read.
+        bool hashFile(const std::string& fileName, uint64_t& hash) const {
+            return fileHashes.get(fileName, hash);
+        }
+
+        static uint64_t hashConfiguration(const std::string& kind, const std::string& baseDirectory);
+        static uint64_t hashCompileCommands(const clang::tooling::CompilationDatabase& compilations, const std::string& sourcePath);
+};
+
+#endif
@@ -13,8 +13,11 @@
 #include "clang/Rewrite/Frontend/Rewriters.h"
 
 #include <fstream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
+#include <vector>
 
 template <typename TargetType>
 class AnalysisFrontendActionFactory : public clang::tooling::FrontendActionFactory
@@ -43,6 +46,12 @@ class AnalysisFrontendActionFactory : public clang::tooling::FrontendActionFacto
         explicit AnalysisFrontendAction(const MetaData& metadata, Candidates<TargetType>& candidates)
             : metadata(metadata), candidates(candidates) {}
 
+        void EndSourceFileAction() {
+            // We remember all files the translation unit depends on, so a cached analysis can be validated.
+            for (const auto& dependency : getDependencies(getCompilerInstance().getSourceManager()))
+                candidates.addDependency(dependency);
+        }
+
         std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef file) {
             return llvm::make_unique<AnalysisASTConsumer>(metadata, candidates);
         }
@@ -58,7 +67,7 @@ public:
 
     // We create a new instance of the frontend action.
     clang::FrontendAction* create() {
-        llvm::outs() << "Phase 1: analysis\n";
+        candidates.log() << "Phase 1: analysis\n";
         return new AnalysisFrontendAction(metadata, candidates);
     }
 };
@@ -70,9 +79,9 @@ class RewritingFrontendActionFactory : public clang::tooling::FrontendActionFact
         class RewritingASTConsumer : public clang::ASTConsumer {
             private:
                 const Transformation& transformation;
-                clang::Rewriter& rewriter;
+                RecordingRewriter& rewriter;
             public:
-                explicit RewritingASTConsumer(const Transformation& transformation, clang::Rewriter& rewriter)
+                explicit RewritingASTConsumer(const Transformation& transformation, RecordingRewriter& rewriter)
                     : transformation(transformation), rewriter(rewriter) {}
 
                 void HandleTranslationUnit(clang::ASTContext &Context) {
@@ -83,12 +92,13 @@ class RewritingFrontendActionFactory : public clang::tooling::FrontendActionFact
 
         private:
         const MetaData& metadata;
+        VersionOutput& output;
         const Transformation& transformation;
-        clang::Rewriter rewriter;
+        RecordingRewriter rewriter;
         const unsigned long id;
         public:
-        explicit RewritingFrontendAction(const MetaData& metadata, const Transformation& transformation, const unsigned long id)
-            : metadata(metadata), transformation(transformation), id(id) {}
+        explicit RewritingFrontendAction(const MetaData& metadata, VersionOutput& output, const Transformation& transformation, const unsigned long id)
+            : metadata(metadata), output(output), transformation(transformation), id(id) {}
 
         void EndSourceFileAction() {
             // We obtain the filename.
@@ -96,86 +106,157 @@ class RewritingFrontendActionFactory : public clang::tooling::FrontendActionFact
 
             // Whenever we are NOT doing analysis we should write out the changes.
             if (rewriter.buffer_begin() != rewriter.buffer_end()) {
-                writeChangesToOutput();
+                writeChangesToOutput(output, metadata.outputPrefix, metadata.baseDirectory, id, rewriter);
 
                 // We need to clear the rewriter's modifications.
                 rewriter.undoChanges();
             }
         }
 
-        void writeChangesToOutput() {
-            // We construct the full output directory.
-            std::stringstream s;
-            s << metadata.outputPrefix << "v" << this->id;
-            std::string fullPath = s.str();
-
-            // Debug
-            llvm::outs() << "Full path: " << fullPath << "\n";
-
-            // We check if this directory exists, if it doesn't we will create it.
-            const int dir_err = system(("mkdir -p " + fullPath).c_str());
-            if (-1 == dir_err)
-            {
-                llvm::outs() << "Error creating directory!\n";
-                return;
+        std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef file) {
+            return llvm::make_unique<RewritingASTConsumer>(transformation, rewriter);
+        }
+    };
+
+private:
+    const MetaData& metadata;
+    VersionOutput& output;
+    const Transformation& transformation;
+    const unsigned long id;
+
+public:
+    RewritingFrontendActionFactory(const MetaData& metadata, VersionOutput& output, const Transformation& transformation, const unsigned long id)
+        : metadata(metadata), output(output), transformation(transformation), id(id) {}
+
+    // We create a new instance of the frontend action.
+    clang::FrontendAction* create() {
+        logs() << "Phase 2: performing rewrite for version: " << id << " target name: " << transformation.target.getName() << "\n";
+        return new RewritingFrontendAction(metadata, output, transformation, id);
+    }
+};
+
+// This class contains a batch of versions to be generated together. The versions are grouped by
+// their target, so the nodes for a target are located once per translation unit and every version
+// of the group is applied to these nodes.
+template <typename RewriterType>
+class VersionBatch {
+    typedef typename RewriterType::Target TargetType;
+    typedef typename TargetType::Nodes NodesType;
+    typedef typename TargetType::Locator LocatorType;
+
+    public:
+        struct Version {
+            unsigned long id;
+            const Transformation* transformation;
+
+            Version(unsigned long id, const Transformation* transformation) : id(id), transformation(transformation) {}
+        };
+
+    private:
+        std::map<TargetType, std::vector<Version>> groups;
+        std::set<std::string> translationUnits;// The translation units affected by the batch
+        unsigned long versions;
+
+    public:
+        VersionBatch() : versions(0) {}
+
+        void add(unsigned long id, const Transformation& transformation, const TargetUnique::Data& data) {
+            groups[static_cast<const TargetType&>(transformation.target)].emplace_back(id, &transformation);
+            translationUnits.insert(data.translationUnits.begin(), data.translationUnits.end());
+            versions++;
+        }
+
+        bool empty() const {
+            return groups.empty();
+        }
+
+        unsigned long size() const {
+            return versions;
+        }
+
+        const std::set<std::string>& getTranslationUnits() const {
+            return translationUnits;
+        }
+
+        // Rewrite a translation unit for all versions in the batch, recording the edits
+        // of every version into its own rewriter.
+        void rewrite(clang::ASTContext& Context, std::map<unsigned long, RecordingRewriter>& rewriters) const {
+            // Locate the nodes for all targets in a single traversal
+            std::map<TargetType, NodesType> nodes;
+            for (const auto& group : groups)
+                nodes[group.first];
+            LocatorType locator(Context, nodes);
+            locator.TraverseDecl(Context.getTranslationUnitDecl());
+
+            // Apply every version of a group to the nodes of its target
+            for (const auto& group : groups) {
+                const NodesType& found = nodes[group.first];
+                for (const auto& version : group.second) {
+                    RewriterType visitor(Context, *version.transformation, rewriters[version.id]);
+                    visitor.rewriteNodes(found);
+                }
+            }
+        }
+
+        // Write the changes for every version that modified the translation unit.
+        static void write(const MetaData& metadata, VersionOutput& output, std::map<unsigned long, RecordingRewriter>& rewriters) {
+            for (auto& it : rewriters) {
+                if (it.second.buffer_begin() != it.second.buffer_end())
+                    writeChangesToOutput(output, metadata.outputPrefix, metadata.baseDirectory, it.first, it.second);
             }
-            // Output stream.
-            std::ofstream outputFile;
-
-            // We write the results to a new location.
-            for (clang::Rewriter::buffer_iterator I = rewriter.buffer_begin(), E = rewriter.buffer_end(); I != E; ++I) {
-
-                llvm::StringRef fileNameRef = rewriter.getSourceMgr().getFileEntryForID(I->first)->getName();
-                std::string fileNameStr = std::string(fileNameRef.data());
-                llvm::outs() << "Obtained filename: " << fileNameStr << "\n";
-                std::string fileName = fileNameStr.substr(fileNameStr.find(metadata.baseDirectory) + metadata.baseDirectory.length()); /* until the end automatically... */
-
-                // Optionally create required subdirectories.
-                {
-                    size_t subDirectoryPos = fileName.find_last_of("/\\");
-                    if (subDirectoryPos != std::string::npos) {
-                        llvm::outs() << "Creating subdirectories..." << "\n";
-                        std::string subdirectories = fileName.substr(0, fileName.find_last_of("/\\"));
-                        llvm::outs() <<  "Extracted subdirectory path: " << subdirectories << "\n";
-                        const int dir_err = system(("mkdir -p " + fullPath + "/" + subdirectories).c_str());
-                        if (-1 == dir_err)
-                        {
-                            llvm::outs() << "Error creating directory!\n";
-                            return;
-                        }
-                    }
+        }
+};
+
+template <typename RewriterType>
+class BatchRewritingFrontendActionFactory : public clang::tooling::FrontendActionFactory
+{
+    class BatchRewritingFrontendAction : public clang::ASTFrontendAction {
+        class BatchRewritingASTConsumer : public clang::ASTConsumer {
+            private:
+                const VersionBatch<RewriterType>& batch;
+                std::map<unsigned long, RecordingRewriter>& rewriters;
+            public:
+                explicit BatchRewritingASTConsumer(const VersionBatch<RewriterType>& batch, std::map<unsigned long, RecordingRewriter>& rewriters)
+                    : batch(batch), rewriters(rewriters) {}
+
+                void HandleTranslationUnit(clang::ASTContext &Context) {
+                    batch.rewrite(Context, rewriters);
                 }
+        };
 
-                // Write changes to the file.
-                std::string outputPath = fullPath + "/" + fileName;
+        private:
+        const MetaData& metadata;
+        VersionOutput& output;
+        const VersionBatch<RewriterType>& batch;
+        std::map<unsigned long, RecordingRewriter> rewriters;// One rewriter per version.
+        public:
+        explicit BatchRewritingFrontendAction(const MetaData& metadata, VersionOutput& output, const VersionBatch<RewriterType>& batch)
+            : metadata(metadata), output(output), batch(batch) {}
 
-                std::string output = std::string(I->second.begin(), I->second.end());
-                outputFile.open(outputPath.c_str());
-                llvm::StringRef MB = rewriter.getSourceMgr().getBufferData(I->first);
-                std::string content = std::string(MB.data());
-                outputFile.write(output.c_str(), output.length());
-                outputFile.close();
-            }
+        void EndSourceFileAction() {
+            // Write out the changes of every version.
+            VersionBatch<RewriterType>::write(metadata, output, rewriters);
+            rewriters.clear();
         }
 
         std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef file) {
-            return llvm::make_unique<RewritingASTConsumer>(transformation, rewriter);
+            return llvm::make_unique<BatchRewritingASTConsumer>(batch, rewriters);
         }
     };
 
 private:
     const MetaData& metadata;
-    const Transformation& transformation;
-    const unsigned long id;
+    VersionOutput& output;
+    const VersionBatch<RewriterType>& batch;
 
 public:
-    RewritingFrontendActionFactory(const MetaData& metadata, const Transformation& transformation, const unsigned long id)
-        : metadata(metadata), transformation(transformation), id(id) {}
+    BatchRewritingFrontendActionFactory(const MetaData& metadata, VersionOutput& output, const VersionBatch<RewriterType>& batch)
+        : metadata(metadata), output(output), batch(batch) {}
 
     // We create a new instance of the frontend action.
     clang::FrontendAction* create() {
-        llvm::outs() << "Phase 2: performing rewrite for version: " << id << " target name: " << transformation.target.getName() << "\n";
-        return new RewritingFrontendAction(metadata, transformation, id);
+        logs() << "Phase 2: performing batched rewrite\n";
+        return new BatchRewritingFrontendAction(metadata, output, batch);
     }
 };
 
@@ -0,0 +1,203 @@
+#include "SemanticGit.h"
+#include "SemanticUtil.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+// The hexadecimal (lowercase) form of an object ID, as git prints it.
+static std::string toHexID(StringRef id) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(id.size() * 2);
+    for (unsigned char c : id) {
+        hex += digits[c >> 4];
+        hex += digits[c & 15];
+    }
+    return hex;
+}
+
+// Write a file through a temporary file in the same directory, so it never exists half written.
+static bool writeAtomically(const std::string& path, StringRef contents) {
+    SmallString<256> temporary;
+    int FD;
+    if (std::error_code error = sys::fs::createUniqueFile(path + "-%%%%%%.tmp", FD, temporary)) {
+        logs() << "Error writing " << path << ": " << error.message() << "\n";
+        return false;
+    }
+
+    bool failed;
+    {
+        raw_fd_ostream stream(FD, /*shouldClose=*/true);
+        stream << contents;
+        stream.close();
+        failed = stream.has_error();
+        stream.clear_error();
+    }
+    if (failed || sys::fs::rename(temporary, path)) {
+        logs() << "Error writing " << path << "\n";
+        sys::fs::remove(temporary);
+        return false;
+    }
+    return true;
+}
+
+GitBackend::GitBackend(const std::string& repository) : repository(repository), valid(false) {
+    // Loose objects are always compressed with zlib.
+    if (!zlib::isAvailable()) {
+        logs() << "Error creating git repository " << repository << ": zlib isn't available\n";
+        return;
+    }
+
+    // The layout of an empty bare repository. An existing repository is reused, the branches of the
+    // versions are replaced.
+    if (!directories.create(repository + "/objects") || !directories.create(repository + "/refs/heads"))
+        return;
+    if (!sys::fs::exists(repository + "/config")
+        && !writeAtomically(repository + "/config", "[core]\n\trepositoryformatversion = 0\n\tfilemode = true\n\tbare = true\n"))
+        return;
+    valid = true;
+}
+
+bool GitBackend::writeObject(StringRef type, StringRef body, std::string& id) {
+    std::stringstream header;
+    header << type.str() << " " << body.size() << '\0';
+    std::string object = header.str();
+    object.append(body.data(), body.size());
+
+    const auto hash = SHA1::hash(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(object.data()), object.size()));
+    id.assign(hash.begin(), hash.end());
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (objects.count(id))
+            return true;
+    }
+
+    // The object might already be stored by an earlier run. Two threads can write the same object at once,
+    // the objects are written atomically.
+    const std::string hex = toHexID(id);
+    const std::string directory = repository + "/objects/" + hex.substr(0, 2);
+    const std::string path = directory + "/" + hex.substr(2);
+    if (!sys::fs::exists(path)) {
+        SmallVector<char, 0> compressed;
+        if (Error error = zlib::compress(object, compressed, zlib::BestSpeedCompression)) {
+            logs() << "Error compressing git object " << hex << ": " << toString(std::move(error)) << "\n";
+            return false;
+        }
+        if (!directories.create(directory) || !writeAtomically(path, StringRef(compressed.data(), compressed.size())))
+            return false;
+    }
+
+    // The object is only known once it is stored, so a failed write is tried again for the next identical object.
+    std::lock_guard<std::mutex> guard(lock);
+    objects.insert(id);
+    return true;
+}
+
+bool GitBackend::write(OutputFile& file) {
+    if (!valid)
+        return false;
+
+    std::string id;
+    if (!writeObject("blob", file.contents, id))
+        return false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    versions[file.version][file.relativePath] = id;
+    return true;
+}
+
+bool GitBackend::writeTree(const Tree& tree, std::string& id) {
+    // The entries of a tree are sorted by name, where the name of a directory is followed by a slash.
+    std::vector<std::pair<std::string, std::string>> entries;
+    for (const auto& file : tree.files)
+        entries.push_back(std::make_pair(file.first, "100644 " + file.first + '\0' + file.second));
+    for (const auto& directory : tree.directories) {
+        std::string directoryID;
+        if (!writeTree(directory.second, directoryID))
+            return false;
+        entries.push_back(std::make_pair(directory.first + "/", "40000 " + directory.first + '\0' + directoryID));
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::string body;
+    for (const auto& entry : entries)
+        body += entry.second;
+    return writeObject("tree", body, id);
+}
+
+bool GitBackend::writeReference(const std::string& name, const std::string& contents) {
+    const std::string path = repository + "/" + name;
+    return directories.create(sys::path::parent_path(path).str()) && writeAtomically(path, contents);
+}
+
+bool GitBackend::finish() {
+    if (!valid)
+        return false;
+
+    // The versions are committed once all their files are written. The commits have no parents, every
+    // version is a separate branch.
+    std::stringstream signature;
+    signature << "semantic-mod <semantic-mod@localhost> " << std::time(nullptr) << " +0000";
+    bool success = true;
+    for (const auto& version : versions) {
+        Tree root;
+        for (const auto& file : version.second) {
+            Tree* tree = &root;
+            StringRef path = file.first;
+            for (size_t separator = path.find('/'); separator != StringRef::npos; separator = path.find('/')) {
+                if (separator != 0)
+                    tree = &tree->directories[path.substr(0, separator).str()];
+                path = path.substr(separator + 1);
+            }
+            tree->files[path.str()] = file.second;
+        }
+
+        std::string treeID;
+        if (!writeTree(root, treeID)) {
+            success = false;
+            continue;
+        }
+
+        std::stringstream commit;
+        commit << "tree " << toHexID(treeID) << "\n";
+        commit << "author " << signature.str() << "\n";
+        commit << "committer " << signature.str() << "\n\n";
+        std::stringstream branch;
+        if (version.first == -1) {
+            commit << "Run\n";
+            branch << "run";
+        } else {
+            commit << "Version " << version.first << "\n";
+            branch << "version/" << version.first;
+        }
+
+        std::string commitID;
+        if (!writeObject("commit", commit.str(), commitID)
+            || !writeReference("refs/heads/" + branch.str(), toHexID(commitID) + "\n"))
+            success = false;
+    }
+
+    // HEAD points at the first version, so the repository can be cloned.
+    auto first = versions.upper_bound(-1);
+    const std::string head = (first != versions.end()) ? "version/" + std::to_string(first->first) : std::string("run");
+    success = writeReference("HEAD", "ref: refs/heads/" + head + "\n") && success;
+
+    logs() << "Wrote " << versions.size() << " branches with " << objects.size() << " objects to " << repository << "\n";
+    versions.clear();
+    return success;
+}
@@ -0,0 +1,47 @@
+#ifndef _SEMANTIC_GIT
+#define _SEMANTIC_GIT
+
+#include "SemanticOutput.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+// This backend stores the output files in a bare git repository, instead of creating a directory tree per
+// version. Every file is written as a blob, every version as a tree and a commit on the branch version/N
+// (the files that describe the whole run are committed on the branch run). Objects are addressed by
+// their contents, so a file that is identical in many versions is only stored once. The objects are
+// written as loose objects (compressed on the I/O threads), which git gc can pack later. The versions can
+// then be checked out or compared with the usual git commands, e.g. git diff version/0 version/1.
+class GitBackend : public OutputBackend {
+    private:
+        // A directory of a version, with the IDs of its files and subdirectories.
+        struct Tree {
+            std::map<std::string, std::string> files;
+            std::map<std::string, Tree> directories;
+        };
+
+        const std::string repository;
+        bool valid;// Whether the repository could be created
+        DirectoryCache directories;// The fan-out directories of the objects
+        std::mutex lock;// Held while accessing the objects and versions
+        std::set<std::string> objects;// The IDs of the objects that have been written
+        std::map<long, std::map<std::string, std::string>> versions;// The blob ID of every file of every version, by path
+
+        // Write an object of a type, unless it has been written already. Returns false if the object
+        // couldn't be written. The (binary) ID of the object is returned through id.
+        bool writeObject(llvm::StringRef type, llvm::StringRef body, std::string& id);
+        bool writeTree(const Tree& tree, std::string& id);
+        bool writeReference(const std::string& name, const std::string& contents);
+
+    public:
+        explicit GitBackend(const std::string& repository);
+
+        bool write(OutputFile& file) override;
+        bool finish() override;
+};
+
+#endif
@@ -0,0 +1,382 @@
+#include "SemanticIOUring.h"
+#include "SemanticUtil.h"
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+#include "llvm/Support/Path.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+// The operations a batch consists of, encoded in the user data of the requests.
+enum BatchOperation {
+    OpenOperation,
+    AllocateOperation,
+    WriteOperation,
+    CloseOperation,
+};
+
+static uint64_t encode(size_t file, BatchOperation operation) {
+    return (uint64_t(file) << 2) | operation;
+}
+
+// This class is a minimal io_uring instance: the submission and completion rings shared with the kernel.
+// It can only be used by a single thread at a time.
+class IOUring {
+    private:
+        int fd;
+        void* sqRing;
+        size_t sqRingSize;
+        void* cqRing;
+        size_t cqRingSize;
+        io_uring_sqe* sqes;
+        size_t sqesSize;
+
+        unsigned* sqTail;
+        unsigned sqMask;
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned cqMask;
+        io_uring_cqe* cqes;
+        unsigned queued;// Requests that have been prepared, but not submitted
+        bool broken;// Whether the kernel refused requests, which leaves the rings in an unknown state
+
+    public:
+        const unsigned entries;
+
+        explicit IOUring(unsigned entries)
+            : fd(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0), sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize(0),
+              queued(0), broken(false), entries(entries) {}
+
+        ~IOUring() {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqesSize);
+            if (cqRing != MAP_FAILED && cqRing != sqRing)
+                munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED)
+                munmap(sqRing, sqRingSize);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        // Set up the rings. Returns false if io_uring, or one of the operations we need, isn't available.
+        bool open() {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd = io_uring_setup(entries, &params);
+            if (fd < 0)
+                return false;
+
+            // Opening, pre-sizing, writing and closing files are all needed.
+            std::vector<char> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+            io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+            if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+                return false;
+            for (unsigned operation : {IORING_OP_OPENAT, IORING_OP_FALLOCATE, IORING_OP_WRITE, IORING_OP_CLOSE}) {
+                if (operation > probe->last_op || !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED))
+                    return false;
+            }
+
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+            sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED)
+                return false;
+            cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing
+                : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED)
+                return false;
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED)
+                return false;
+
+            char* sq = static_cast<char*>(sqRing);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            char* cq = static_cast<char*>(cqRing);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            // Every slot of the submission queue always refers to the request with the same index.
+            unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            for (unsigned iii = 0; iii < params.sq_entries; iii++)
+                array[iii] = iii;
+            return true;
+        }
+
+        bool isBroken() const {
+            return broken;
+        }
+
+        // The number of requests that are prepared, but not submitted. After a failed run, these requests are
+        // never executed.
+        unsigned getUnsubmitted() const {
+            return queued;
+        }
+
+        // Prepare a request. At most as many requests as there are entries can be prepared before running them.
+        io_uring_sqe& prepare(uint8_t opcode, int fileDescriptor, uint64_t userData) {
+            const unsigned tail = *sqTail + queued;
+            io_uring_sqe& sqe = sqes[tail & sqMask];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode;
+            sqe.fd = fileDescriptor;
+            sqe.user_data = userData;
+            queued++;
+            return sqe;
+        }
+
+        // Submit the prepared requests, and wait for a number of completions. Every completion is passed
+        // to the handler. Returns false if the kernel refused the requests.
+        template <typename Handler>
+        bool run(unsigned completions, Handler handler) {
+            __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+            while (queued > 0 || completions > 0) {
+                const int submitted = io_uring_enter(fd, queued, completions > 0 ? 1 : 0, IORING_ENTER_GETEVENTS);
+                if (submitted < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    broken = true;
+                    return false;
+                }
+                queued -= submitted;
+
+                unsigned head = *cqHead;
+                const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+                for (; head != tail && completions > 0; head++, completions--)
+                    handler(cqes[head & cqMask]);
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            return true;
+        }
+};
+
+// Write the part of a file io_uring didn't write, with plain system calls.
+static bool writeRemainder(const OutputFile& file, size_t written) {
+    const int fd = ::open(file.path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    while (written < file.contents.size()) {
+        const ssize_t result = pwrite(fd, file.contents.data() + written, file.contents.size() - written, written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            break;
+        written += result;
+    }
+    return (close(fd) == 0) && written == file.contents.size();
+}
+
+// This backend writes the batches of files the output writer hands to it. It doesn't keep files itself, so
+// all files that aren't written yet are counted by the output writer. Every thread writing a batch needs its
+// own ring, so the rings are kept in a pool that grows to the number of threads writing at the same time.
+class IOUringBackend : public OutputBackend {
+    private:
+        DirectoryCache directories;
+        const size_t batchSize;
+
+        std::mutex lock;
+        std::vector<std::unique_ptr<IOUring>> rings;// The rings that aren't in use
+
+        std::unique_ptr<IOUring> acquireRing();
+        void releaseRing(std::unique_ptr<IOUring> ring);
+        bool writeFiles(IOUring& ring, std::vector<OutputFile>& batch);
+
+    public:
+        IOUringBackend(unsigned batchSize) : batchSize(batchSize) {}
+
+        // Set up the first ring. Returns false if io_uring isn't available.
+        bool open() {
+            std::unique_ptr<IOUring> ring = acquireRing();
+            if (!ring)
+                return false;
+            releaseRing(std::move(ring));
+            return true;
+        }
+
+        bool write(OutputFile& file) override;
+        bool writeBatch(std::vector<OutputFile>& batch) override;
+
+        size_t getBatchSize() const override {
+            return batchSize;
+        }
+};
+
+std::unique_ptr<IOUring> IOUringBackend::acquireRing() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!rings.empty()) {
+            std::unique_ptr<IOUring> ring = std::move(rings.back());
+            rings.pop_back();
+            return ring;
+        }
+    }
+
+    // A batch takes at most three requests per file.
+    std::unique_ptr<IOUring> ring(new IOUring(batchSize * 4));
+    if (!ring->open())
+        return nullptr;
+    return ring;
+}
+
+void IOUringBackend::releaseRing(std::unique_ptr<IOUring> ring) {
+    std::lock_guard<std::mutex> guard(lock);
+    rings.push_back(std::move(ring));
+}
+
+bool IOUringBackend::write(OutputFile& file) {
+    std::vector<OutputFile> batch;
+    batch.push_back(std::move(file));
+    return writeBatch(batch);
+}
+
+bool IOUringBackend::writeBatch(std::vector<OutputFile>& batch) {
+    bool result = true;
+    for (auto& file : batch) {
+        const std::string directory = llvm::sys::path::parent_path(file.path).str();
+        if (!directory.empty() && !directories.create(directory))
+            result = false;
+    }
+
+    // A batch that is larger than the rings is written in parts.
+    std::unique_ptr<IOUring> ring = acquireRing();
+    if (!ring)
+        return false;
+    bool written = result;
+    for (size_t start = 0; start < batch.size() && !ring->isBroken(); start += batchSize) {
+        std::vector<OutputFile> part;
+        for (size_t iii = start; iii < std::min(batch.size(), start + batchSize); iii++)
+            part.push_back(std::move(batch[iii]));
+        written = writeFiles(*ring, part) && written;
+    }
+    if (!ring->isBroken())
+        releaseRing(std::move(ring));
+    return written;
+}
+
+bool IOUringBackend::writeFiles(IOUring& ring, std::vector<OutputFile>& batch) {
+    bool result = true;
+
+    // We open all files of the batch at once.
+    std::vector<int> descriptors(batch.size(), -1);
+    for (size_t iii = 0; iii < batch.size(); iii++) {
+        io_uring_sqe& sqe = ring.prepare(IORING_OP_OPENAT, AT_FDCWD, encode(iii, OpenOperation));
+        sqe.addr = reinterpret_cast<uint64_t>(batch[iii].path.c_str());
+        sqe.len = 0666;
+        sqe.open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    }
+    if (!ring.run(batch.size(), [&](const io_uring_cqe& cqe) { descriptors[cqe.user_data >> 2] = cqe.res; })) {
+        // The files that were opened are closed here. The completions of the other requests are lost with the ring.
+        for (auto descriptor : descriptors) {
+            if (descriptor >= 0)
+                close(descriptor);
+        }
+        logs() << "Error writing a batch of " << batch.size() << " files: io_uring failed\n";
+        return false;
+    }
+
+    // Then we pre-size, write and close them. The requests of a file are linked, so they are executed in
+    // order, and the file is closed even when pre-sizing (which not all file systems support) fails.
+    std::vector<ssize_t> written(batch.size(), 0);
+    std::vector<unsigned> closeRequests(batch.size(), 0);// The position of the request closing every file
+    unsigned completions = 0;
+    for (size_t iii = 0; iii < batch.size(); iii++) {
+        if (descriptors[iii] < 0) {
+            logs() << "Error writing " << batch[iii].path << ": " << std::strerror(-descriptors[iii]) << "\n";
+            result = false;
+            continue;
+        }
+
+        const std::string& contents = batch[iii].contents;
+        if (!contents.empty()) {
+            io_uring_sqe& allocate = ring.prepare(IORING_OP_FALLOCATE, descriptors[iii], encode(iii, AllocateOperation));
+            allocate.addr = contents.size();
+            allocate.flags = IOSQE_IO_HARDLINK;
+            io_uring_sqe& write = ring.prepare(IORING_OP_WRITE, descriptors[iii], encode(iii, WriteOperation));
+            write.addr = reinterpret_cast<uint64_t>(contents.data());
+            write.len = contents.size();
+            write.flags = IOSQE_IO_HARDLINK;
+            completions += 2;
+        }
+        ring.prepare(IORING_OP_CLOSE, descriptors[iii], encode(iii, CloseOperation));
+        closeRequests[iii] = completions++;
+    }
+    if (!ring.run(completions, [&](const io_uring_cqe& cqe) {
+            const size_t file = cqe.user_data >> 2;
+            switch (cqe.user_data & 3) {
+                case WriteOperation:
+                    written[file] = cqe.res;
+                    break;
+                case CloseOperation:
+                    if (cqe.res < 0)
+                        written[file] = cqe.res;
+                    break;
+            }
+        })) {
+        // The requests are submitted in order, so the files whose close request wasn't submitted are closed here.
+        const unsigned submitted = completions - ring.getUnsubmitted();
+        for (size_t iii = 0; iii < batch.size(); iii++) {
+            if (descriptors[iii] >= 0 && closeRequests[iii] >= submitted)
+                close(descriptors[iii]);
+        }
+        logs() << "Error writing a batch of " << batch.size() << " files: io_uring failed\n";
+        return false;
+    }
+
+    // A write can be short, the rest is written with plain system calls.
+    for (size_t iii = 0; iii < batch.size(); iii++) {
+        if (descriptors[iii] < 0 || written[iii] == static_cast<ssize_t>(batch[iii].contents.size()))
+            continue;
+        if (written[iii] < 0 || !writeRemainder(batch[iii], written[iii])) {
+            logs() << "Error writing " << batch[iii].path << "\n";
+            result = false;
+        }
+    }
+    return result;
+}
+
+std::unique_ptr<OutputBackend> createIOUringBackend(unsigned batchSize) {
+    std::unique_ptr<IOUringBackend> backend(new IOUringBackend(std::max(batchSize, 1u)));
+    if (backend->open())
+        return backend;
+
+    logs() << "io_uring isn't available, writing the output files with plain system calls\n";
+    return std::unique_ptr<OutputBackend>(new DirectoryBackend());
+}
+
+#else
+
+std::unique_ptr<OutputBackend> createIOUringBackend(unsigned) {
+    logs() << "io_uring isn't available, writing the output files with plain system calls\n";
+    return std::unique_ptr<OutputBackend>(new DirectoryBackend());
+}
+
+#endif
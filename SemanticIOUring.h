@@ -0,0 +1,15 @@
+#ifndef _SEMANTIC_IO_URING
+#define _SEMANTIC_IO_URING
+
+#include "SemanticOutput.h"
+
+#include <memory>
+
+// Method used to create a backend that writes the output files through io_uring. The output writer hands
+// the files over in batches (of at most the batch size), and every batch takes two system calls: one that opens all files of the batch, and one
+// that pre-sizes, writes and closes them. The raw system calls are used, so no library is needed. When
+// io_uring isn't available (on other systems, older kernels, or when it's forbidden), a directory
+// backend is returned instead.
+std::unique_ptr<OutputBackend> createIOUringBackend(unsigned batchSize = 64);
+
+#endif
@@ -0,0 +1,174 @@
+#include "SemanticMaterialize.h"
+#include "SemanticUtil.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+
+using namespace llvm;
+
+// Clone a file into a new file, so both share their contents until one of them is modified. Returns 0 on
+// success and the error number otherwise.
+static int cloneFile(const std::string& source, const std::string& destination) {
+#if defined(__linux__) && defined(FICLONE)
+    const int sourceFD = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (sourceFD < 0)
+        return errno;
+    struct stat status;
+    if (fstat(sourceFD, &status) != 0) {
+        const int error = errno;
+        close(sourceFD);
+        return error;
+    }
+
+    const int destinationFD = open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, status.st_mode & 07777);
+    if (destinationFD < 0) {
+        const int error = errno;
+        close(sourceFD);
+        return error;
+    }
+
+    const int error = (ioctl(destinationFD, FICLONE, sourceFD) == 0) ? 0 : errno;
+    close(destinationFD);
+    close(sourceFD);
+    if (error)
+        unlink(destination.c_str());
+    return error;
+#else
+    (void)source;
+    (void)destination;
+    return EOPNOTSUPP;
+#endif
+}
+
+// Read the target of a symbolic link. Returns false if the path isn't a link.
+static bool readLink(const std::string& path, std::string& target) {
+#if defined(__unix__) || defined(__APPLE__)
+    std::vector<char> buffer(256);
+    while (true) {
+        const ssize_t length = readlink(path.c_str(), buffer.data(), buffer.size());
+        if (length < 0)
+            return false;
+        if (static_cast<size_t>(length) < buffer.size()) {
+            target.assign(buffer.data(), length);
+            return true;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+#else
+    (void)path;
+    (void)target;
+    return false;
+#endif
+}
+
+TreeMaterializer::TreeMaterializer(const std::string& baseDirectory, const std::string& outputDirectory)
+    : baseDirectory(baseDirectory), cloning(true), linking(true), cloned(0), linked(0), copied(0) {
+    SmallString<256> output;
+    if (sys::fs::real_path(outputDirectory, output))
+        output = outputDirectory;
+
+    std::error_code error;
+    for (sys::fs::recursive_directory_iterator it(baseDirectory, error), end; it != end && !error; it.increment(error)) {
+        const std::string path = it->path();
+        std::string target;
+        if (sys::fs::is_symlink_file(path)) {
+            // The link itself is recreated, the iterator mustn't descend into a linked directory.
+            it.no_push();
+            if (readLink(path, target))
+                links.push_back(std::make_pair(getRelativePath(path, baseDirectory), target));
+            else
+                logs() << "Error reading link " << path << "\n";
+        } else if (sys::fs::is_directory(path)) {
+            SmallString<256> real;
+            if (!sys::fs::real_path(path, real) && real == output)
+                it.no_push();
+        } else if (sys::fs::is_regular_file(path))
+            files.push_back(getRelativePath(path, baseDirectory));
+    }
+    if (error)
+        logs() << "Error scanning " << baseDirectory << ": " << error.message() << "\n";
+}
+
+bool TreeMaterializer::place(const std::string& source, const std::string& destination) {
+    if (cloning) {
+        const int error = cloneFile(source, destination);
+        if (!error) {
+            cloned++;
+            return true;
+        }
+
+        // These errors mean the file system (or the kernel) can't clone files at all.
+        if (error == EOPNOTSUPP || error == ENOTTY || error == EXDEV || error == EINVAL || error == ENOSYS)
+            cloning = false;
+    }
+
+    if (linking) {
+        const std::error_code error = sys::fs::create_hard_link(source, destination);
+        if (!error) {
+            linked++;
+            return true;
+        }
+        if (error == std::errc::cross_device_link || error == std::errc::operation_not_permitted || error == std::errc::function_not_supported)
+            linking = false;
+    }
+
+    if (std::error_code error = sys::fs::copy_file(source, destination)) {
+        logs() << "Error copying " << source << " to " << destination << ": " << error.message() << "\n";
+        return false;
+    }
+
+    // A copy is created with the default permissions, so e.g. scripts would lose their executable bit.
+    ErrorOr<sys::fs::perms> permissions = sys::fs::getPermissions(source);
+    if (!permissions || sys::fs::setPermissions(destination, *permissions)) {
+        logs() << "Error copying the permissions of " << source << " to " << destination << "\n";
+        return false;
+    }
+    copied++;
+    return true;
+}
+
+bool TreeMaterializer::materialize(const std::string& versionDirectory) {
+    bool success = true;
+    for (const auto& file : files) {
+        const std::string destination = versionDirectory + "/" + file;
+        if (sys::fs::exists(destination))
+            continue;
+
+        const std::string directory = sys::path::parent_path(destination).str();
+        if (!directories.create(directory) || !place(baseDirectory + file, destination))
+            success = false;
+    }
+
+    for (const auto& link : links) {
+        const std::string destination = versionDirectory + "/" + link.first;
+        if (sys::fs::exists(destination) || sys::fs::is_symlink_file(destination))
+            continue;
+
+        const std::string directory = sys::path::parent_path(destination).str();
+        if (!directories.create(directory))
+            success = false;
+        else if (std::error_code error = sys::fs::create_link(link.second, destination)) {
+            logs() << "Error creating link " << destination << ": " << error.message() << "\n";
+            success = false;
+        }
+    }
+    return success;
+}
+
+void TreeMaterializer::printStatistics() const {
+    logs() << "Materialized the unmodified files: " << cloned << " cloned, " << linked << " hard linked, " << copied << " copied\n";
+}
@@ -0,0 +1,44 @@
+#ifndef _SEMANTIC_MATERIALIZE
+#define _SEMANTIC_MATERIALIZE
+
+#include "SemanticOutput.h"
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+// This class completes the directories of versions with the files of the base directory that weren't
+// rewritten, so every version is a full source tree. The files are cloned (reflinked) when the file
+// system supports it, hard linked otherwise, and only copied when neither works (e.g. when the output
+// directory is on another file system). Cloning and linking only create metadata, the contents are
+// shared with the base directory. A hard linked file is the same file as the one in the base directory,
+// so it must not be modified in place. Copies keep the permissions of the original files. Symbolic links
+// are recreated as links with the same target (a link to a directory isn't followed). The files that
+// already exist in a version directory are the rewritten ones and are left alone, so a version must be
+// completed after its files are written. It can be used by multiple threads.
+class TreeMaterializer {
+    private:
+        const std::string baseDirectory;
+        std::vector<std::string> files;// The paths of the files of the base directory, relative to it
+        std::vector<std::pair<std::string, std::string>> links;// The paths of the symbolic links, relative to it, and their targets
+        DirectoryCache directories;
+        std::atomic<bool> cloning;// Whether files can be cloned, until it fails for the file system
+        std::atomic<bool> linking;// Whether files can be hard linked, until it fails for the file system
+        std::atomic<unsigned long> cloned;
+        std::atomic<unsigned long> linked;
+        std::atomic<unsigned long> copied;
+
+        bool place(const std::string& source, const std::string& destination);
+
+    public:
+        // Scan the base directory. The output directory is skipped when it lies inside of it.
+        TreeMaterializer(const std::string& baseDirectory, const std::string& outputDirectory);
+
+        // Complete the directory of a version. Returns false if not all files could be placed.
+        bool materialize(const std::string& versionDirectory);
+
+        void printStatistics() const;
+};
+
+#endif
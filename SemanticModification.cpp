@@ -6,7 +6,9 @@
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 
 #include <string>
 #include <vector>
@@ -30,6 +32,41 @@ static cl::opt<std::string> BaseDirectory("bd", cl::cat(MainCategory));
 static cl::opt<unsigned> NumberOfVersions("nr_of_versions", cl::cat(MainCategory));
 static cl::opt<std::string> TransformationType("transtype", cl::cat(MainCategory));
 static cl::opt<unsigned> Seed("seed", cl::init((unsigned)0), cl::desc("The seed for the PRNG."), cl::cat(MainCategory));
+static cl::opt<GenerationOptions::SamplingPolicy> Sampling("sampling", cl::init(GenerationOptions::UnrankSampling), cl::desc("How versions are chosen:"),
+    cl::values(clEnumValN(GenerationOptions::UnrankSampling, "unrank", "Distinct versions without rejection"),
+               clEnumValN(GenerationOptions::UniformSampling, "uniform", "Uniform candidate, retry duplicates"),
+               clEnumValN(GenerationOptions::WeightedSampling, "weighted", "Candidate weighted by its remaining versions"),
+               clEnumValN(GenerationOptions::EnumerateSampling, "enumerate", "All versions")), cl::cat(MainCategory));
+static cl::opt<double> Saturation("saturation", cl::init(0.5), cl::desc("Enumerate the versions instead of unranking them when at least this fraction of all versions is requested (0 disables this). The uniform and weighted sampling are never replaced."), cl::cat(MainCategory));
+static cl::opt<bool> EnumerateInOrder("enumerate_in_order", cl::desc("Enumerate the versions in order, instead of in the order of a seeded permutation."), cl::cat(MainCategory));
+static cl::opt<unsigned> Jobs("j", cl::init((unsigned)1), cl::desc("The number of threads used to analyse translation units and generate versions."), cl::cat(MainCategory));
+static cl::opt<bool> ReuseASTs("reuse_asts", cl::desc("Parse every translation unit once and rewrite all versions from the cached ASTs."), cl::cat(MainCategory));
+static cl::opt<bool> FusedRewrite("fused", cl::desc("Rewrite a batch of versions in a single traversal of every translation unit."), cl::cat(MainCategory));
+static cl::opt<unsigned> BatchSize("batch_size", cl::init((unsigned)0), cl::desc("The number of versions in a window (and a fused batch), 0 means 1024."), cl::cat(MainCategory));
+static cl::opt<bool> Splice("splice", cl::desc("Generate versions by splicing the source ranges recorded during analysis, without invoking clang."), cl::cat(MainCategory));
+static cl::opt<std::string> ASTSnapshots("ast_snapshots", cl::desc("Directory in which serialized ASTs are kept, so later runs can load them instead of parsing (implies reuse_asts)."), cl::cat(MainCategory));
+static cl::opt<unsigned> ASTSnapshotCapacity("ast_snapshot_capacity", cl::init((unsigned)10240), cl::desc("The maximum size (in MB) of the AST snapshots."), cl::cat(MainCategory));
+static cl::opt<bool> ReusePreambles("preambles", cl::desc("Parse the headers included by a translation unit once, into a precompiled preamble that is reused when rewriting it."), cl::cat(MainCategory));
+static cl::opt<bool> AnalysisCache("analysis_cache", cl::desc("Store the results of the analysis in the output directory, and reuse them when the sources didn't change."), cl::cat(MainCategory));
+static cl::opt<unsigned> ASTMemoryBudget("ast_memory_budget", cl::init((unsigned)4096), cl::desc("The memory budget (in MB) for cached ASTs, shared by all jobs (every job gets an equal part, and caches the translation units assigned to it). Within a window of versions (batch_size) every translation unit is parsed once and rewritten for all versions of the window. When the ASTs don't fit in the budget, the least recently used ones are evicted and parsed again in the next window."), cl::cat(MainCategory));
+static cl::opt<bool> Patch("patch", cl::desc("Write a single unified diff (version.patch) per version instead of the rewritten files."), cl::cat(MainCategory));
+static cl::opt<bool> Materialize("materialize", cl::desc("Complete every version directory with the files of the base directory that weren't rewritten, by cloning them (or hard linking or copying them when the file system can't clone). Hard linked files are the files of the base directory, so they must not be modified in place. Only for the posix and io_uring outputs without patches."), cl::cat(MainCategory));
+static cl::opt<bool> VFSOverlay("vfs_overlay", cl::desc("Write a VFS overlay (vfsoverlay.yaml) that maps the rewritten files over the base directory, and a compile_commands.json that passes it with -ivfsoverlay, to every version directory. Only for the posix and io_uring outputs without patches."), cl::cat(MainCategory));
+static cl::opt<GenerationOptions::OutputBackendKind> WriterBackend("output_backend", cl::init(GenerationOptions::DirectoryOutput), cl::desc("How the output files are written:"),
+    cl::values(clEnumValN(GenerationOptions::DirectoryOutput, "posix", "A system call per operation"),
+               clEnumValN(GenerationOptions::IOUringOutput, "io_uring", "Batched, falls back to posix when io_uring isn't available"),
+               clEnumValN(GenerationOptions::PackOutput, "pack", "A single compressed pack file with an index, versions.pack in the output directory"),
+               clEnumValN(GenerationOptions::TarOutput, "tar", "A tar archive streamed to the standard output"),
+               clEnumValN(GenerationOptions::GitOutput, "git", "A bare git repository with a branch per version, versions.git in the output directory")), cl::cat(MainCategory));
+static cl::opt<unsigned> OutputThreads("output_threads", cl::init((unsigned)2), cl::desc("The number of threads writing the output files in the background (0 writes them inline)."), cl::cat(MainCategory));
+static cl::opt<unsigned> OutputBuffer("output_buffer", cl::init((unsigned)256), cl::desc("The maximum size (in MB) of the output files waiting to be written."), cl::cat(MainCategory));
+
+// Make the path in a command line option absolute, relative to the current working directory.
+static void makeAbsolute(cl::opt<std::string>& path) {
+    SmallString<256> absolutePath(path.getValue());
+    sys::fs::make_absolute(absolutePath);
+    path = absolutePath.str().str();
+}
 
 // Entry point of our tool.
 int main(int argc, const char **argv) {
@@ -37,6 +74,13 @@ int main(int argc, const char **argv) {
     // Default options parser.
     CommonOptionsParser OptionsParser(argc, argv, MainCategory);
 
+    // The directories are used by worker and background threads, while ClangTool changes the working directory
+    // of the process, so their paths have to be absolute.
+    makeAbsolute(BaseDirectory);
+    makeAbsolute(OutputDirectory);
+    if (!ASTSnapshots.empty())
+        makeAbsolute(ASTSnapshots);
+
     // If the BaseDirectory path doesn't have a trailing slash, add one
     if (*BaseDirectory.rbegin() != '/')
       BaseDirectory.append("/");
@@ -45,24 +89,47 @@ int main(int argc, const char **argv) {
     if (*OutputDirectory.rbegin() != '/')
       OutputDirectory.append("/");
 
-    // Initialize random seed.
-    init_random(Seed);
-
-    // Retrieve source path list from options parser.
-    const std::vector<std::string> srcPathList = OptionsParser.getSourcePathList();
+    // Retrieve source path list from options parser. ClangTool resolves a relative source path against the
+    // working directory of the process, which other jobs may have changed, so the paths are made absolute first.
+    std::vector<std::string> srcPathList;
+    for (const auto& sourcePath : OptionsParser.getSourcePathList()) {
+        SmallString<256> absoluteSourcePath(sourcePath);
+        sys::fs::make_absolute(absoluteSourcePath);
+        srcPathList.push_back(absoluteSourcePath.str().str());
+    }
 
-    // Initialize the Tool.
-    ClangTool Tool(OptionsParser.getCompilations(), srcPathList);
+    // Options that determine how the versions are generated.
+    GenerationOptions options;
+    options.reuseASTs = ReuseASTs;
+    options.astMemoryBudget = (unsigned long)ASTMemoryBudget * 1024 * 1024;
+    options.astSnapshotDirectory = ASTSnapshots;
+    options.astSnapshotCapacity = (unsigned long)ASTSnapshotCapacity * 1024 * 1024;
+    options.fusedRewrite = FusedRewrite;
+    options.batchSize = BatchSize;
+    options.splice = Splice;
+    options.reusePreambles = ReusePreambles;
+    options.analysisCache = AnalysisCache;
+    options.jobs = Jobs;
+    options.seed = Seed;
+    options.sampling = Sampling;
+    options.saturation = Saturation;
+    options.shuffleEnumeration = !EnumerateInOrder;
+    options.patch = Patch;
+    options.materialize = Materialize;
+    options.vfsOverlay = VFSOverlay;
+    options.outputBackend = WriterBackend;
+    options.outputThreads = OutputThreads;
+    options.maxInFlightOutput = (unsigned long)OutputBuffer * 1024 * 1024;
 
     // We determine what kind of transformation to apply.
     if (TransformationType == "StructReordering") {
-        generateVersions<StructReorderingRewriter>(&Tool, BaseDirectory, OutputDirectory, NumberOfVersions);
+        generateVersions<StructReorderingRewriter>(OptionsParser.getCompilations(), srcPathList, BaseDirectory, OutputDirectory, NumberOfVersions, options);
     } else if (TransformationType == "StructInsertion") {
-        generateVersions<StructInsertionRewriter>(&Tool, BaseDirectory, OutputDirectory, NumberOfVersions);
+        generateVersions<StructInsertionRewriter>(OptionsParser.getCompilations(), srcPathList, BaseDirectory, OutputDirectory, NumberOfVersions, options);
     } else if (TransformationType == "FPReordering") {
-        generateVersions<FPReorderingRewriter>(&Tool, BaseDirectory, OutputDirectory, NumberOfVersions);
+        generateVersions<FPReorderingRewriter>(OptionsParser.getCompilations(), srcPathList, BaseDirectory, OutputDirectory, NumberOfVersions, options);
     } else if (TransformationType == "FPInsertion") {
-        generateVersions<FPInsertionRewriter>(&Tool, BaseDirectory, OutputDirectory, NumberOfVersions);
+        generateVersions<FPInsertionRewriter>(OptionsParser.getCompilations(), srcPathList, BaseDirectory, OutputDirectory, NumberOfVersions, options);
     }
 
     // Succes.
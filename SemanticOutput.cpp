@@ -0,0 +1,139 @@
+#include "SemanticOutput.h"
+#include "SemanticUtil.h"
+
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <fstream>
+
+bool DirectoryCache::create(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (directories.count(path))
+            return true;
+    }
+
+    // Creating a directory that already exists isn't an error, so threads can race to create the same one.
+    if (std::error_code error = llvm::sys::fs::create_directories(path)) {
+        logs() << "Error creating directory " << path << ": " << error.message() << "\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    directories.insert(path);
+    return true;
+}
+
+OutputRegistry::Status OutputRegistry::claim(unsigned long version, const llvm::sys::fs::UniqueID& file, uint64_t contentHash) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto result = files[version].insert(std::make_pair(file, contentHash));
+    if (result.second)
+        return New;
+
+    return (result.first->second == contentHash) ? Duplicate : Conflict;
+}
+
+void OutputRegistry::release(unsigned long version) {
+    std::lock_guard<std::mutex> guard(lock);
+    files.erase(version);
+}
+
+void VersionFileCollector::add(unsigned long version, const std::string& relativePath, std::string text) {
+    std::lock_guard<std::mutex> guard(lock);
+    files[version][relativePath] = std::move(text);
+}
+
+std::map<std::string, std::string> VersionFileCollector::take(unsigned long version) {
+    std::map<std::string, std::string> result;
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = files.find(version);
+    if (it != files.end()) {
+        result.swap(it->second);
+        files.erase(it);
+    }
+    return result;
+}
+
+bool DirectoryBackend::write(OutputFile& file) {
+    const std::string directory = llvm::sys::path::parent_path(file.path).str();
+    if (!directory.empty() && !directories.create(directory))
+        return false;
+
+    std::ofstream outputFile;
+    outputFile.open(file.path.c_str());
+    outputFile.write(file.contents.data(), file.contents.size());
+    outputFile.close();
+    if (outputFile.fail()) {
+        logs() << "Error writing " << file.path << "\n";
+        return false;
+    }
+    return true;
+}
+
+OutputWriter::~OutputWriter() {
+    finish();
+}
+
+void OutputWriter::work() {
+    const size_t batchSize = std::max(backend->getBatchSize(), (size_t)1);
+    std::vector<OutputFile> files;
+    std::vector<unsigned long> costs;
+    OutputFile file;
+    unsigned long cost;
+    while (queue->pop(file, cost)) {
+        // The files that are already waiting are written together with this one.
+        do {
+            files.push_back(std::move(file));
+            costs.push_back(cost);
+        } while (files.size() < batchSize && queue->tryPop(file, cost));
+
+        {
+            LogBuffer buffer;
+            if (!backend->writeBatch(files))
+                failed = true;
+        }
+
+        // Release the memory of the files before making room for the next ones.
+        files.clear();
+        for (auto fileCost : costs)
+            queue->finish(fileCost);
+        costs.clear();
+    }
+}
+
+void OutputWriter::configure(std::unique_ptr<OutputBackend> newBackend, unsigned nrOfThreads, unsigned long maxInFlight) {
+    finish();
+    backend = std::move(newBackend);
+    failed = false;
+    if (nrOfThreads == 0)
+        return;
+
+    queue.reset(new BoundedQueue<OutputFile>(maxInFlight));
+    for (unsigned iii = 0; iii < nrOfThreads; iii++)
+        threads.emplace_back(&OutputWriter::work, this);
+}
+
+bool OutputWriter::write(OutputFile file) {
+    if (!queue)
+        return backend->write(file);
+
+    const unsigned long cost = file.contents.size();
+    queue->push(std::move(file), cost);
+    return true;
+}
+
+bool OutputWriter::finish() {
+    if (queue) {
+        queue->close();
+        for (auto& thread : threads)
+            thread.join();
+        threads.clear();
+        queue.reset();
+    }
+    const bool result = backend->finish() && !failed;
+
+    // A backend is only finished once, later files go to the output directory.
+    backend.reset(new DirectoryBackend());
+    failed = false;
+    return result;
+}
@@ -0,0 +1,172 @@
+#ifndef _SEMANTIC_OUTPUT
+#define _SEMANTIC_OUTPUT
+
+#include "SemanticPipeline.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// This class creates directories without spawning a shell, and remembers the directories that exist so
+// every directory is only created once. It can be used by multiple threads.
+class DirectoryCache {
+    private:
+        std::mutex lock;
+        std::set<std::string> directories;// The directories known to exist
+
+    public:
+        // Make sure a directory and its parents exist. Returns false, and reports the error, if the
+        // directory couldn't be created.
+        bool create(const std::string& path);
+};
+
+// This class remembers which files have been written for every version. A header that is included by
+// many translation units is rewritten by all of them, so only the first rewritten buffer of a file is
+// written, and the buffers of later translation units are only compared to it (by content hash). The
+// files are identified by their unique ID, so different paths to the same file are recognized. Once a
+// version is finished, its files are released. The registry can be used by multiple threads.
+class OutputRegistry {
+    public:
+        enum Status {
+            New,// The file hasn't been written for the version yet, and should be written
+            Duplicate,// The file has already been written for the version, with the same contents
+            Conflict,// The file has already been written for the version, with different contents
+        };
+
+    private:
+        std::mutex lock;
+        std::map<unsigned long, std::map<llvm::sys::fs::UniqueID, uint64_t>> files;// The content hash of every written file, by version
+
+    public:
+        // Register the contents of a file for a version.
+        Status claim(unsigned long version, const llvm::sys::fs::UniqueID& file, uint64_t contentHash);
+
+        // Forget the files of a version, once all its translation units are rewritten.
+        void release(unsigned long version);
+};
+
+// This class collects a text per file (by path relative to the base directory) for every version, e.g. the
+// diffs of the files of a patch, so they can be written together once all translation units of the version
+// are rewritten. It can be used by multiple threads.
+class VersionFileCollector {
+    private:
+        std::mutex lock;
+        std::map<unsigned long, std::map<std::string, std::string>> files;// The texts of every version, by relative path
+
+    public:
+        void add(unsigned long version, const std::string& relativePath, std::string text);
+
+        // Take the texts collected for a version, ordered by path.
+        std::map<std::string, std::string> take(unsigned long version);
+};
+
+// A file written to the output.
+struct OutputFile {
+    std::string path;// The path of the file in the output directory
+    long version;// The version the file belongs to, -1 for the files that describe the whole run
+    std::string relativePath;// The path of the file within its version
+    std::string contents;
+
+    OutputFile() : version(-1) {}
+    OutputFile(std::string path, long version, std::string relativePath, std::string contents)
+        : path(std::move(path)), version(version), relativePath(std::move(relativePath)), contents(std::move(contents)) {}
+};
+
+// This class stores the output files. The backends can be used by multiple threads.
+class OutputBackend {
+    public:
+        virtual ~OutputBackend() {}
+
+        // Store a file. Returns false, and reports the error, if the file couldn't be stored.
+        virtual bool write(OutputFile& file) = 0;
+
+        // The number of files the backend prefers to store at once.
+        virtual size_t getBatchSize() const {
+            return 1;
+        }
+
+        // Store a batch of files. Returns false if one of them couldn't be stored.
+        virtual bool writeBatch(std::vector<OutputFile>& files) {
+            bool result = true;
+            for (auto& file : files)
+                result = write(file) && result;
+            return result;
+        }
+
+        // Called once all files have been written.
+        virtual bool finish() {
+            return true;
+        }
+};
+
+// This backend writes every file to its path in the output directory.
+class DirectoryBackend : public OutputBackend {
+    private:
+        DirectoryCache directories;
+
+    public:
+        bool write(OutputFile& file) override;
+};
+
+// This class is the last stage of the version generation pipeline: it hands the output files to a backend.
+// With I/O threads, the files are queued and written in the background, while the other stages go on
+// with the next versions. The files in the queue (or being written) are limited to a number of bytes, so
+// the other stages wait when they produce files faster than the I/O threads can write them. An I/O thread
+// takes the files that are waiting in the queue as a batch, up to the batch size of the backend, and they
+// count against the limit until the whole batch is written. Without I/O threads, every file is written on
+// the thread that produces it.
+class OutputWriter {
+    private:
+        std::unique_ptr<OutputBackend> backend;
+        std::unique_ptr<BoundedQueue<OutputFile>> queue;
+        std::vector<std::thread> threads;
+        std::atomic<bool> failed;// Whether a queued file couldn't be written
+
+        void work();
+
+    public:
+        OutputWriter() : backend(new DirectoryBackend()), failed(false) {}
+        ~OutputWriter();
+
+        // Use another backend, with a number of I/O threads and a limit (in bytes) on the queued files.
+        // Waits until the files of the previous configuration are written.
+        void configure(std::unique_ptr<OutputBackend> newBackend, unsigned nrOfThreads, unsigned long maxInFlight);
+
+        // Write a file, or queue it. Returns false if the file was written and failed.
+        bool write(OutputFile file);
+
+        // Wait until all files are written, stop the I/O threads and finish the backend. Returns false if
+        // a file couldn't be written.
+        bool finish();
+};
+
+// This class holds the output of a run: the writer of the output files, the files written for every version,
+// and what is collected for the patch and the overlay of every version. It is owned by the run and passed to
+// everything that writes output. What is kept for a version is dropped once the version is finished.
+class VersionOutput {
+    public:
+        OutputWriter writer;
+        OutputRegistry registry;
+        VersionFileCollector patches;// The diffs of the files of every version
+        VersionFileCollector overlays;// The files written for every version, the texts are empty
+        const bool patch;// Whether a patch is written per version, instead of the rewritten files
+        const bool overlay;// Whether a VFS overlay is written per version
+
+        VersionOutput(bool patch, bool overlay) : patch(patch), overlay(overlay) {}
+
+        // Drop what is kept for a version, once its patch and overlay are written.
+        void release(unsigned long version) {
+            registry.release(version);
+        }
+};
+
+#endif
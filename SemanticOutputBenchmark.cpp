@@ -0,0 +1,93 @@
+// Benchmark of the output backends. It writes a synthetic output, shaped like the versions generated for a
+// project (a number of versions, each with the same set of files in a few subdirectories), with every
+// backend, and reports the time each backend took. The pack is read back, to check its contents.
+
+#include "SemanticArchive.h"
+#include "SemanticGit.h"
+#include "SemanticIOUring.h"
+#include "SemanticOutput.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<std::string> Directory("directory", cl::init("."), cl::desc("The directory in which a scratch directory is created for the files (the scratch directory is removed afterwards)."));
+static cl::opt<unsigned> Files("files", cl::init((unsigned)50000), cl::desc("The total number of files."));
+static cl::opt<unsigned> FilesPerVersion("files_per_version", cl::init((unsigned)50), cl::desc("The number of files of every version."));
+static cl::opt<unsigned> FileSize("file_size", cl::init((unsigned)8192), cl::desc("The size (in bytes) of every file."));
+static cl::opt<unsigned> OutputThreads("output_threads", cl::init((unsigned)2), cl::desc("The number of threads writing the files (0 writes them inline)."));
+static cl::opt<unsigned> BatchSize("batch_size", cl::init((unsigned)64), cl::desc("The number of files in an io_uring batch."));
+
+// Write the synthetic output with a backend to a directory, and report how long it took.
+static void run(const std::string& name, std::unique_ptr<OutputBackend> backend, const std::string& directory) {
+    const std::string contents(FileSize, 'x');
+
+    const auto start = std::chrono::steady_clock::now();
+    OutputWriter writer;
+    writer.configure(std::move(backend), OutputThreads, 256ul * 1024 * 1024);
+    for (unsigned iii = 0; iii < Files; iii++) {
+        const unsigned version = iii / FilesPerVersion;
+        const unsigned file = iii % FilesPerVersion;
+        std::stringstream relativePath;
+        relativePath << "src" << (file % 4) << "/file" << file << ".c";
+        std::stringstream path;
+        path << directory << "/v" << version << "/" << relativePath.str();
+        writer.write(OutputFile(path.str(), version, relativePath.str(), contents));
+    }
+    const bool success = writer.finish();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    outs() << name << ": " << Files << " files in " << format("%.2f", elapsed.count()) << " s (" << format("%.0f", Files / elapsed.count())
+           << " files/s, " << format("%.1f", double(Files) * FileSize / elapsed.count() / (1024 * 1024)) << " MB/s)"
+           << (success ? "" : ", with errors") << "\n";
+}
+
+// Read a pack back, and check that it holds every file with the right contents.
+static void verifyPack(const std::string& path) {
+    PackReader reader;
+    if (!reader.open(path))
+        return;
+
+    const std::string expected(FileSize, 'x');
+    unsigned valid = 0;
+    for (const auto& entry : reader.getEntries()) {
+        std::string contents;
+        if (reader.extract(entry, contents) && contents == expected)
+            valid++;
+    }
+    outs() << "pack: read back " << valid << " of " << Files << " files" << ((valid == Files && reader.getEntries().size() == Files) ? "" : ", with errors") << "\n";
+}
+
+int main(int argc, const char** argv) {
+    cl::ParseCommandLineOptions(argc, argv, "Benchmark of the output backends of semantic-mod\n");
+    if (FilesPerVersion == 0)
+        FilesPerVersion = 1;
+
+    // Everything is written to a new directory, so only files the benchmark created are removed.
+    SmallString<256> scratch;
+    if (std::error_code error = sys::fs::create_directories(Directory)) {
+        errs() << "Error creating " << Directory << ": " << error.message() << "\n";
+        return 1;
+    }
+    if (std::error_code error = sys::fs::createUniqueDirectory(Directory + "/output-benchmark", scratch)) {
+        errs() << "Error creating a scratch directory in " << Directory << ": " << error.message() << "\n";
+        return 1;
+    }
+
+    run("posix", std::unique_ptr<OutputBackend>(new DirectoryBackend()), scratch.str().str() + "/posix");
+    run("io_uring", createIOUringBackend(BatchSize), scratch.str().str() + "/io_uring");
+    run("pack", std::unique_ptr<OutputBackend>(new PackBackend(scratch.str().str() + "/versions.pack")), scratch.str().str() + "/pack");
+    verifyPack(scratch.str().str() + "/versions.pack");
+    run("git", std::unique_ptr<OutputBackend>(new GitBackend(scratch.str().str() + "/versions.git")), scratch.str().str() + "/git");
+    sys::fs::remove_directories(scratch);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "SemanticOverlay.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+#include <map>
+
+using namespace llvm;
+
+Json::Value makeVFSOverlay(const std::string& baseDirectory, const std::string& versionDirectory, const std::set<std::string>& relativePaths) {
+    // Every directory containing rewritten files becomes a root, clang merges the roots into a single tree.
+    std::map<std::string, Json::Value> directories;
+    for (const auto& relativePath : relativePaths) {
+        SmallString<256> original(baseDirectory);
+        sys::path::append(original, relativePath);
+        SmallString<256> rewritten(versionDirectory);
+        sys::path::append(rewritten, relativePath);
+
+        Json::Value file;
+        file["type"] = "file";
+        file["name"] = sys::path::filename(original).str();
+        file["external-contents"] = rewritten.str().str();
+        directories[sys::path::parent_path(original).str()].append(file);
+    }
+
+    Json::Value overlay;
+    // The version is written as a string: the YAML parser of clang doesn't strip the newline after the last
+    // (unquoted) value of a mapping, and clang reads the scalars as strings anyway.
+    overlay["version"] = "0";
+    // Diagnostics and debug information refer to the paths in the base directory.
+    overlay["use-external-names"] = false;
+    overlay["roots"] = Json::Value(Json::arrayValue);
+    for (const auto& directory : directories) {
+        Json::Value root;
+        root["type"] = "directory";
+        root["name"] = directory.first;
+        root["contents"] = directory.second;
+        overlay["roots"].append(root);
+    }
+    return overlay;
+}
+
+bool acceptsVFSOverlay(const clang::tooling::CompileCommand& command) {
+    if (command.CommandLine.empty())
+        return false;
+
+    // E.g. clang, clang++, clang-6.0 or x86_64-linux-gnu-clang++. The options of clang-cl are those of cl.
+    const StringRef compiler = sys::path::filename(command.CommandLine[0]);
+    return (compiler.startswith("clang") || compiler.find("-clang") != StringRef::npos) && compiler.find("clang-cl") == StringRef::npos;
+}
+
+Json::Value makeCompilationDatabase(const std::vector<clang::tooling::CompileCommand>& commands, const std::string& overlayPath) {
+    Json::Value database(Json::arrayValue);
+    for (const auto& command : commands) {
+        Json::Value entry;
+        entry["directory"] = command.Directory;
+        entry["file"] = command.Filename;
+
+        // The overlay is passed right after the compiler.
+        const bool overlay = acceptsVFSOverlay(command);
+        Json::Value arguments(Json::arrayValue);
+        for (size_t iii = 0; iii < command.CommandLine.size(); iii++) {
+            arguments.append(command.CommandLine[iii]);
+            if (iii == 0 && overlay) {
+                arguments.append("-ivfsoverlay");
+                arguments.append(overlayPath);
+            }
+        }
+        entry["arguments"] = arguments;
+        database.append(entry);
+    }
+    return database;
+}
@@ -0,0 +1,26 @@
+#ifndef _SEMANTIC_OVERLAY
+#define _SEMANTIC_OVERLAY
+
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include "json.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+// Method used to create the VFS overlay of a version (for clang's -ivfsoverlay). The overlay maps the files
+// written for the version over the same paths in the base directory, so a build of the version reads the
+// files that weren't rewritten from the base directory itself. Both directories must be absolute. The
+// overlay is written as JSON, which the YAML parser of clang reads as well.
+Json::Value makeVFSOverlay(const std::string& baseDirectory, const std::string& versionDirectory, const std::set<std::string>& relativePaths);
+
+// Method used to check whether the compiler of a compile command is clang, so it accepts -ivfsoverlay.
+bool acceptsVFSOverlay(const clang::tooling::CompileCommand& command);
+
+// Method used to create the compilation database of a version: the compile commands of the translation
+// units, with the VFS overlay of the version added to every command whose compiler accepts it. The other
+// commands are left unchanged, so they build the base directory.
+Json::Value makeCompilationDatabase(const std::vector<clang::tooling::CompileCommand>& commands, const std::string& overlayPath);
+
+#endif
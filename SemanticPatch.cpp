@@ -0,0 +1,197 @@
+#include "SemanticPatch.h"
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace clang;
+using namespace llvm;
+
+// The number of unchanged lines around every change in a diff.
+static const unsigned ContextLines = 3;
+
+// This class finds the lines of a file. The file is only scanned up to the lines that are needed.
+class LineIndex {
+    private:
+        StringRef text;
+        std::vector<size_t> starts;// The offset at which every line starts
+        bool complete;// Whether all lines have been found
+
+        // Find the lines up to the one containing an offset.
+        void extend(size_t offset) {
+            while (!complete && starts.back() <= offset) {
+                const size_t newline = text.find('\n', starts.back());
+                if (newline == StringRef::npos || newline + 1 == text.size())
+                    complete = true;
+                else
+                    starts.push_back(newline + 1);
+            }
+        }
+
+    public:
+        explicit LineIndex(StringRef text) : text(text), starts(1, 0), complete(text.empty()) {}
+
+        // The number of lines, a trailing newline doesn't start another line.
+        size_t size() {
+            extend(text.size());
+            return text.empty() ? 0 : starts.size();
+        }
+
+        // The line containing the character at an offset.
+        size_t lineOf(size_t offset) {
+            extend(offset);
+            return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+        }
+
+        size_t start(size_t line) {
+            return (line < size()) ? starts[line] : text.size();
+        }
+
+        // The end of a line, including its newline.
+        size_t end(size_t line) {
+            return start(line + 1);
+        }
+};
+
+// A range of lines changed by one or more edits.
+struct ChangeBlock {
+    size_t first;// The first line
+    size_t end;// The line after the last one
+    std::vector<const SourceEdit*> edits;
+    std::string replacement;// The new lines
+};
+
+// Append a line to a diff.
+static void appendLine(std::string& diff, char prefix, StringRef line) {
+    diff += prefix;
+    diff.append(line.data(), line.size());
+    if (line.empty() || line.back() != '\n')
+        diff += "\n\\ No newline at end of file\n";
+}
+
+// Split a text into lines, keeping the newlines.
+static std::vector<StringRef> splitLines(StringRef text) {
+    std::vector<StringRef> lines;
+    while (!text.empty()) {
+        const size_t length = std::min(text.find('\n'), text.size() - 1) + 1;
+        lines.push_back(text.substr(0, length));
+        text = text.substr(length);
+    }
+    return lines;
+}
+
+// The hunk header of a range of lines. An empty range is identified by the line before it.
+static void appendRange(std::stringstream& header, size_t start, size_t count) {
+    header << ((count == 0) ? start : start + 1);
+    if (count != 1)
+        header << "," << count;
+}
+
+std::string makeUnifiedDiff(const std::string& relativePath, StringRef original, std::vector<SourceEdit> edits) {
+    std::sort(edits.begin(), edits.end());
+    LineIndex lines(original);
+
+    // Group the edits into blocks of changed lines. Edits on the same line end up in the same block.
+    std::vector<ChangeBlock> blocks;
+    for (const auto& edit : edits) {
+        if (edit.length == 0 && edit.replacement.empty())
+            continue;
+
+        ChangeBlock block;
+        if (edit.offset >= original.size() && (original.empty() || original.back() == '\n')) {
+            // Appended to the file, after the last line.
+            block.first = block.end = lines.size();
+        } else {
+            block.first = lines.lineOf(edit.offset);
+            block.end = lines.lineOf(edit.length ? edit.offset + edit.length - 1 : edit.offset) + 1;
+        }
+
+        if (!blocks.empty() && block.first < blocks.back().end) {
+            blocks.back().end = std::max(blocks.back().end, block.end);
+            blocks.back().edits.push_back(&edit);
+        } else {
+            block.edits.push_back(&edit);
+            blocks.push_back(block);
+        }
+    }
+
+    // The new lines are the old lines with the edits applied. When an edit removes the newline at the end
+    // of the block, the next line is joined to the new lines, so it becomes part of the block.
+    for (size_t iii = 0; iii < blocks.size(); iii++) {
+        ChangeBlock& block = blocks[iii];
+        while (true) {
+            block.replacement.clear();
+            size_t position = lines.start(block.first);
+            for (const SourceEdit* edit : block.edits) {
+                block.replacement.append(original.data() + position, edit->offset - position);
+                block.replacement.append(edit->replacement);
+                position = edit->offset + edit->length;
+            }
+            block.replacement.append(original.data() + position, lines.start(block.end) - position);
+
+            const bool joinsNext = (iii + 1 < blocks.size() && blocks[iii + 1].first == block.end);
+            if (block.replacement.empty() || block.replacement.back() == '\n' || (block.end >= lines.size() && !joinsNext))
+                break;
+            if (joinsNext) {
+                block.edits.insert(block.edits.end(), blocks[iii + 1].edits.begin(), blocks[iii + 1].edits.end());
+                block.end = blocks[iii + 1].end;
+                blocks.erase(blocks.begin() + iii + 1);
+            } else
+                block.end++;
+        }
+    }
+
+    std::string diff = "--- a/" + relativePath + "\n+++ b/" + relativePath + "\n";
+    long delta = 0;// The number of lines added by the previous hunks
+    for (size_t iii = 0; iii < blocks.size();) {
+        // A hunk contains the blocks whose context lines touch.
+        size_t last = iii;
+        while (last + 1 < blocks.size() && blocks[last + 1].first <= blocks[last].end + 2 * ContextLines)
+            last++;
+        const size_t first = (blocks[iii].first > ContextLines) ? blocks[iii].first - ContextLines : 0;
+        const size_t end = std::min(lines.size(), blocks[last].end + ContextLines);
+
+        std::string body;
+        long hunkDelta = 0;
+        size_t line = first;
+        for (; iii <= last; iii++) {
+            const ChangeBlock& block = blocks[iii];
+            for (; line < block.first; line++)
+                appendLine(body, ' ', original.slice(lines.start(line), lines.end(line)));
+            for (; line < block.end; line++)
+                appendLine(body, '-', original.slice(lines.start(line), lines.end(line)));
+
+            const std::vector<StringRef> newLines = splitLines(block.replacement);
+            for (const auto& newLine : newLines)
+                appendLine(body, '+', newLine);
+            hunkDelta += long(newLines.size()) - long(block.end - block.first);
+        }
+        for (; line < end; line++)
+            appendLine(body, ' ', original.slice(lines.start(line), lines.end(line)));
+
+        std::stringstream header;
+        header << "@@ -";
+        appendRange(header, first, end - first);
+        header << " +";
+        appendRange(header, first + delta, end - first + hunkDelta);
+        header << " @@\n";
+        diff += header.str();
+        diff += body;
+        delta += hunkDelta;
+    }
+    return diff;
+}
+
+bool RecordingRewriter::ReplaceText(SourceRange range, StringRef text) {
+    if (Rewriter::ReplaceText(range, text))
+        return true;
+
+    // The rewriter replaces the range up to the end of its last token.
+    const SourceManager& sm = getSourceMgr();
+    const std::pair<FileID, unsigned> begin = sm.getDecomposedLoc(range.getBegin());
+    const unsigned end = sm.getFileOffset(range.getEnd()) + Lexer::MeasureTokenLength(range.getEnd(), sm, getLangOpts());
+    edits[begin.first].emplace_back(begin.second, end - begin.second, text.str());
+    return false;
+}
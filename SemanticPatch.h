@@ -0,0 +1,37 @@
+#ifndef _SEMANTIC_PATCH
+#define _SEMANTIC_PATCH
+
+#include "SemanticSplicing.h"
+
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Method used to create the unified diff of a file from the edits made to it. The diff is derived from the
+// edits and the lines around them, the original and the rewritten file aren't compared. The edits must
+// not overlap. The paths in the headers are prefixed with a/ and b/, so the diff applies with patch -p1.
+std::string makeUnifiedDiff(const std::string& relativePath, llvm::StringRef original, std::vector<SourceEdit> edits);
+
+// This rewriter records the edits made through it (in offsets of the original files), so a diff can be
+// derived from them.
+class RecordingRewriter : public clang::Rewriter {
+    private:
+        std::map<clang::FileID, std::vector<SourceEdit>> edits;
+
+    public:
+        // Replace the text of a token range, and record the edit. Returns true if the range can't be
+        // rewritten, like the rewriter.
+        bool ReplaceText(clang::SourceRange range, llvm::StringRef text);
+
+        // Get the edits made to a file, or nullptr if it wasn't edited.
+        const std::vector<SourceEdit>* getEdits(clang::FileID file) const {
+            auto it = edits.find(file);
+            return (it != edits.end()) ? &it->second : nullptr;
+        }
+};
+
+#endif
@@ -0,0 +1,49 @@
+// Test of the check that decides whether translation units can be parsed by multiple threads at once. Every
+// case is a compilation database (as it is read from compile_commands.json) together with the expected result.
+
+#include "SemanticUtil.h"
+
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+// Check a single database, and report whether the check gave the expected result.
+static bool check(const std::string& name, const std::string& json, const std::string& sourcePath, bool expected) {
+    std::string error;
+    std::unique_ptr<clang::tooling::JSONCompilationDatabase> database
+        = clang::tooling::JSONCompilationDatabase::loadFromBuffer(json, error, clang::tooling::JSONCommandLineSyntax::AutoDetect);
+    if (!database) {
+        errs() << name << ": error loading the database: " << error << "\n";
+        return false;
+    }
+
+    std::string reason;
+    const bool absolute = usesAbsolutePaths(*database, std::vector<std::string>(1, sourcePath), reason);
+    outs() << name << ": " << (absolute ? "absolute" : "relative, " + reason) << "\n";
+    if (absolute != expected) {
+        errs() << name << ": expected " << (expected ? "absolute" : "relative") << " paths\n";
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool success = true;
+    success = check("absolute", "[{ \"directory\" : \"/src\", \"file\" : \"/src/main.c\", "
+                    "\"command\" : \"clang -I/src/include -isystem /usr/include -c /src/main.c\" }]", "/src/main.c", true) && success;
+    success = check("relative directory", "[{ \"directory\" : \"build\", \"file\" : \"/src/main.c\", "
+                    "\"command\" : \"clang -c /src/main.c\" }]", "/src/main.c", false) && success;
+    success = check("relative file", "[{ \"directory\" : \"/src\", \"file\" : \"main.c\", "
+                    "\"command\" : \"clang -c main.c\" }]", "/src/main.c", false) && success;
+    success = check("joined include path", "[{ \"directory\" : \"/src\", \"file\" : \"/src/main.c\", "
+                    "\"command\" : \"clang -Iinclude -c /src/main.c\" }]", "/src/main.c", false) && success;
+    success = check("separate include path", "[{ \"directory\" : \"/src\", \"file\" : \"/src/main.c\", "
+                    "\"command\" : \"clang -isystem ../include -c /src/main.c\" }]", "/src/main.c", false) && success;
+    success = check("included file", "[{ \"directory\" : \"/src\", \"file\" : \"/src/main.c\", "
+                    "\"command\" : \"clang -include config.h -c /src/main.c\" }]", "/src/main.c", false) && success;
+    return success ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#ifndef _SEMANTIC_PIPELINE
+#define _SEMANTIC_PIPELINE
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// This class connects two stages of a pipeline. Every item has a cost (e.g. its size in bytes), and an item
+// is in flight from the moment it's pushed until the consumer marks it as finished. The producer blocks
+// while the items in flight cost more than the capacity, so a slow consumer slows down the producer instead
+// of letting the items pile up in memory. An item is always accepted when nothing is in flight, so a single
+// item that costs more than the capacity doesn't block forever. The queue can be used by multiple producers
+// and consumers.
+template <typename T>
+class BoundedQueue {
+    private:
+        const unsigned long capacity;
+        std::mutex lock;
+        std::condition_variable changed;// Signalled when an item is pushed or finished, or the queue is closed
+        std::deque<std::pair<T, unsigned long>> items;
+        unsigned long load;// The cost of the items in flight
+        unsigned long unfinished;// The number of items in flight
+        bool closed;
+
+    public:
+        explicit BoundedQueue(unsigned long capacity) : capacity(capacity), load(0), unfinished(0), closed(false) {}
+
+        // Add an item, waiting until there's room for it.
+        void push(T item, unsigned long cost) {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return unfinished == 0 || load + cost <= capacity; });
+            load += cost;
+            unfinished++;
+            items.emplace_back(std::move(item), cost);
+            changed.notify_all();
+        }
+
+        // Take the oldest item, waiting until there is one. Returns false once the queue is closed and empty.
+        bool pop(T& item, unsigned long& cost) {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return closed || !items.empty(); });
+            if (items.empty())
+                return false;
+
+            item = std::move(items.front().first);
+            cost = items.front().second;
+            items.pop_front();
+            return true;
+        }
+
+        // Take the oldest item if there is one, without waiting.
+        bool tryPop(T& item, unsigned long& cost) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (items.empty())
+                return false;
+
+            item = std::move(items.front().first);
+            cost = items.front().second;
+            items.pop_front();
+            return true;
+        }
+
+        // Mark an item that was taken as finished, which makes room for new items.
+        void finish(unsigned long cost) {
+            std::lock_guard<std::mutex> guard(lock);
+            load -= cost;
+            unfinished--;
+            changed.notify_all();
+        }
+
+        // Wait until all items are finished.
+        void wait() {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return unfinished == 0; });
+        }
+
+        // Stop the consumers once all items have been taken.
+        void close() {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+            changed.notify_all();
+        }
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "SemanticPreamble.h"
+#include "SemanticUtil.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using namespace llvm;
+
+void PreambleCache::attach(CompilerInvocation& invocation, FileManager& files, std::shared_ptr<PCHContainerOperations> PCHContainerOps) {
+    const FrontendOptions& frontendOptions = invocation.getFrontendOpts();
+    if (frontendOptions.Inputs.size() != 1 || !frontendOptions.Inputs[0].isFile())
+        return;
+
+    const std::string mainFile = frontendOptions.Inputs[0].getFile();
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = files.getBufferForFile(mainFile);
+    if (!buffer)
+        return;
+
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::shared_ptr<Entry>& slot = entries[mainFile];
+        if (!slot)
+            slot = std::make_shared<Entry>();
+        entry = slot;
+    }
+
+    IntrusiveRefCntPtr<vfs::FileSystem> VFS = files.getVirtualFileSystem();
+    const PreambleBounds bounds = ComputePreambleBounds(*invocation.getLangOpts(), buffer->get(), 0);
+
+    // Only the first parse of a translation unit builds its preamble, the others wait for it.
+    std::call_once(entry->built, [&]() {
+        if (bounds.Size == 0)
+            return;
+
+        logs() << "Building preamble of: " << mainFile << "\n";
+        IgnoringDiagConsumer diagnosticConsumer;
+        IntrusiveRefCntPtr<DiagnosticsEngine> diagnostics = CompilerInstance::createDiagnostics(&invocation.getDiagnosticOpts(), &diagnosticConsumer, false);
+        PreambleCallbacks callbacks;
+        ErrorOr<PrecompiledPreamble> preamble = PrecompiledPreamble::Build(invocation, buffer->get(), bounds, *diagnostics, VFS,
+                PCHContainerOps, /*StoreInMemory=*/false, callbacks);
+        if (!preamble) {
+            logs() << "Error building preamble of: " << mainFile << "\n";
+            return;
+        }
+        entry->preamble.reset(new PrecompiledPreamble(std::move(*preamble)));
+    });
+
+    // A preamble stored in a file doesn't need another file system, so the VFS is left as it is.
+    if (entry->preamble && entry->preamble->CanReuse(invocation, buffer->get(), bounds, VFS.get()))
+        entry->preamble->AddImplicitPreamble(invocation, VFS, buffer->get());
+}
+
+bool PreambleToolAction::runInvocation(std::shared_ptr<CompilerInvocation> invocation, FileManager* files,
+        std::shared_ptr<PCHContainerOperations> PCHContainerOps, DiagnosticConsumer* diagnostics) {
+    cache.attach(*invocation, *files, PCHContainerOps);
+    return action.runInvocation(std::move(invocation), files, std::move(PCHContainerOps), diagnostics);
+}
+
+int runTool(tooling::ClangTool& tool, tooling::ToolAction& action, PreambleCache* cache) {
+    if (!cache)
+        return tool.run(&action);
+
+    PreambleToolAction preambleAction(action, *cache);
+    return tool.run(&preambleAction);
+}
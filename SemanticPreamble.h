@@ -0,0 +1,51 @@
+#ifndef _SEMANTIC_PREAMBLE
+#define _SEMANTIC_PREAMBLE
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
+#include "clang/Tooling/Tooling.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// This class keeps a precompiled preamble (the leading block of #include directives, compiled into a PCH)
+// for every translation unit. The preamble of a translation unit is built the first time it's parsed, and
+// all later parses of the translation unit only deserialize it, instead of parsing the headers again. The
+// preambles are stored in temporary files, which are removed when the cache is destroyed. The cache can
+// be used by multiple threads.
+class PreambleCache {
+    private:
+        struct Entry {
+            std::once_flag built;
+            std::unique_ptr<clang::PrecompiledPreamble> preamble;// Null if the preamble couldn't be built
+        };
+
+        std::mutex lock;
+        std::map<std::string, std::shared_ptr<Entry>> entries;// The preambles, by main file
+
+    public:
+        // Let the invocation use the preamble of its main file, building the preamble if needed.
+        void attach(clang::CompilerInvocation& invocation, clang::FileManager& files, std::shared_ptr<clang::PCHContainerOperations> PCHContainerOps);
+};
+
+// This tool action runs the frontend actions of another one, using precompiled preambles.
+class PreambleToolAction : public clang::tooling::ToolAction {
+    private:
+        clang::tooling::ToolAction& action;
+        PreambleCache& cache;
+
+    public:
+        PreambleToolAction(clang::tooling::ToolAction& action, PreambleCache& cache) : action(action), cache(cache) {}
+
+        bool runInvocation(std::shared_ptr<clang::CompilerInvocation> invocation, clang::FileManager* files,
+                std::shared_ptr<clang::PCHContainerOperations> PCHContainerOps, clang::DiagnosticConsumer* diagnostics) override;
+};
+
+// Method used to run a tool, with the precompiled preambles of a cache if there is one.
+int runTool(clang::tooling::ClangTool& tool, clang::tooling::ToolAction& action, PreambleCache* cache);
+
+#endif
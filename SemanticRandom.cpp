@@ -0,0 +1,89 @@
+#include "SemanticRandom.h"
+
+#include <numeric>
+#include <utility>
+
+static inline void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+    const uint64_t product = (uint64_t)a * b;
+    hi = product >> 32;
+    lo = (uint32_t)product;
+}
+
+Philox::Counter Philox::generate(Counter counter, Key key) {
+    for (unsigned round = 0; round < 10; round++) {
+        uint32_t hi0, lo0, hi1, lo1;
+        mulhilo(0xD2511F53u, counter[0], hi0, lo0);
+        mulhilo(0xCD9E8D57u, counter[2], hi1, lo1);
+        counter = {{hi1 ^ counter[1] ^ key[0], lo1, hi0 ^ counter[3] ^ key[1], lo0}};
+
+        // Bump the key (Weyl sequence)
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+uint32_t RandomStream::next32() {
+    // Every block contains four numbers.
+    const uint64_t index = draw / 4;
+    if (index != blockIndex) {
+        const Philox::Counter counter = {{(uint32_t)index, (uint32_t)(index >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)}};
+        block = Philox::generate(counter, key);
+        blockIndex = index;
+    }
+    return block[draw++ % 4];
+}
+
+uint64_t RandomStream::next64() {
+    const uint64_t hi = next32();
+    return (hi << 32) | next32();
+}
+
+unsigned RandomStream::random_0_to_n(const unsigned n) {
+    if (n == UINT32_MAX)
+        return next32();
+
+    // Reject the numbers that would bias the modulo.
+    const uint32_t range = n + 1;
+    const uint32_t limit = UINT32_MAX - (UINT32_MAX % range + 1) % range;
+    uint32_t number;
+    do {
+        number = next32();
+    } while (number > limit);
+
+    return number % range;
+}
+
+VersionCount RandomStream::random_below(const VersionCount& bound) {
+    // Draw numbers with as many bits as the bound, and reject those that aren't below it. On
+    // average less than two numbers are drawn.
+    const unsigned bits = bound.bitLength();
+    std::vector<uint32_t> limbs((bits + 31) / 32);
+    VersionCount number;
+    do {
+        for (auto& limb : limbs)
+            limb = next32();
+        if (bits % 32)
+            limbs.back() &= (1u << (bits % 32)) - 1;
+        number = VersionCount::fromLimbs(limbs);
+    } while (number >= bound);
+
+    return number;
+}
+
+std::vector<unsigned> RandomStream::random_ordering(unsigned nrOfElements) {
+    // Create original ordering
+    std::vector<unsigned> ordering(nrOfElements);
+    std::iota(ordering.begin(), ordering.end(), 0);
+    if (nrOfElements < 2)
+        return ordering;
+
+    // Make sure the modified ordering isn't the same as the original (Fisher-Yates shuffle)
+    const std::vector<unsigned> original_ordering = ordering;
+    do {
+        for (unsigned iii = nrOfElements - 1; iii > 0; iii--)
+            std::swap(ordering[iii], ordering[random_0_to_n(iii)]);
+    } while (original_ordering == ordering);
+
+    return ordering;
+}
@@ -0,0 +1,49 @@
+#ifndef _SEMANTIC_RANDOM
+#define _SEMANTIC_RANDOM
+
+#include "SemanticCount.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Counter-based pseudo random number generator (Philox4x32-10). Every block of random numbers
+// is a pure function of a key and a counter, so there is no state that has to be shared.
+class Philox {
+    public:
+        typedef std::array<uint32_t, 4> Counter;
+        typedef std::array<uint32_t, 2> Key;
+
+        static Counter generate(Counter counter, Key key);
+};
+
+// A stream of random numbers, identified by a seed and a stream id (e.g. the version id). The n'th
+// number of the stream is computed from (seed, stream, n), so every stream can be recomputed on its
+// own and streams can be used on different threads without locking.
+class RandomStream {
+    private:
+        const Philox::Key key;
+        const uint64_t stream;
+        uint64_t draw;// Index of the next number to draw
+        Philox::Counter block;// The block containing the previous number
+        uint64_t blockIndex;
+
+    public:
+        RandomStream(unsigned seed, uint64_t stream, uint64_t draw = 0)
+            : key({{seed, 0x53656d61u}}), stream(stream), draw(draw), blockIndex(UINT64_MAX) {}
+
+        // Draw a uniformly distributed 32 or 64 bit number.
+        uint32_t next32();
+        uint64_t next64();
+
+        // Draw a number between 0 and n ([0, n]).
+        unsigned random_0_to_n(const unsigned n);
+
+        // Draw a number below a bound ([0, bound)), the bound being larger than 0.
+        VersionCount random_below(const VersionCount& bound);
+
+        // Generate a random ordering that differs from the original ordering
+        std::vector<unsigned> random_ordering(unsigned nrOfElements);
+};
+
+#endif
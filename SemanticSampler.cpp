@@ -0,0 +1,185 @@
+#include "SemanticSampler.h"
+#include "SemanticRandom.h"
+
+#include <algorithm>
+#include <numeric>
+
+std::vector<unsigned> unrank_permutation(unsigned nrOfElements, VersionCount rank) {
+    // Decode the rank into its factorial number system digits: digit i has radix i + 1.
+    std::vector<unsigned> digits(nrOfElements);
+    for (unsigned iii = 0; iii < nrOfElements; iii++)
+        digits[iii] = rank.divide(iii + 1);
+
+    // The digit with the largest radix selects the first element from the remaining ones, and so on.
+    std::vector<unsigned> remaining(nrOfElements);
+    std::iota(remaining.begin(), remaining.end(), 0);
+    std::vector<unsigned> ordering;
+    ordering.reserve(nrOfElements);
+    for (unsigned iii = nrOfElements; iii > 0; iii--) {
+        const unsigned digit = digits[iii - 1];
+        ordering.push_back(remaining[digit]);
+        remaining.erase(remaining.begin() + digit);
+    }
+
+    return ordering;
+}
+
+FeistelPermutation::FeistelPermutation(uint64_t size, unsigned seed) : size(size), seed(seed), halfBits(0), mask(0) {
+    // The network works on an even number of bits that can represent every index.
+    unsigned bits = 0;
+    while (bits < 64 && (size - 1) >> bits)
+        bits++;
+    halfBits = (bits + 1) / 2;
+    mask = (halfBits == 32) ? UINT32_MAX : (((uint64_t)1 << halfBits) - 1);
+}
+
+uint64_t FeistelPermutation::encrypt(uint64_t value) const {
+    uint64_t left = value >> halfBits;
+    uint64_t right = value & mask;
+    for (uint32_t round = 0; round < 6; round++) {
+        // The round function is a block of the counter-based generator.
+        const Philox::Counter counter = {{(uint32_t)right, round, 0x46656973u, 0}};
+        const Philox::Key key = {{seed, 0x74656c21u}};
+        const uint64_t mixed = left ^ (Philox::generate(counter, key)[0] & mask);
+        left = right;
+        right = mixed;
+    }
+    return (left << halfBits) | right;
+}
+
+uint64_t FeistelPermutation::permute(uint64_t index) const {
+    // The network permutes the full domain exactly.
+    if (size == 0)
+        return encrypt(index);
+    if (size == 1)
+        return index;
+
+    // The network permutes [0, 4^halfBits), which is less than four times the size, so the expected
+    // number of walks is small.
+    uint64_t value = index;
+    do {
+        value = encrypt(value);
+    } while (value >= size);
+
+    return value;
+}
+
+static std::vector<VersionCount> computePrefixSums(const std::vector<VersionCount>& versionCounts) {
+    std::vector<VersionCount> prefixSums(1, 0);
+    for (const auto& count : versionCounts)
+        prefixSums.push_back(prefixSums.back() + count);
+    return prefixSums;
+}
+
+VersionSampler::VersionSampler(const std::vector<VersionCount>& versionCounts, unsigned seed)
+    : prefixSums(computePrefixSums(versionCounts)),
+      permutation(prefixSums.back().fitsIn64() ? prefixSums.back().toUInt64() : 0, seed) {}
+
+VersionCount VersionSampler::sample(uint64_t n) const {
+    if (totalVersions().fitsIn64())
+        return permutation.permute(n);
+
+    // There are at least 2^64 versions, so at most 2^64 of them can be requested. We permute all 64-bit values
+    // and scale the result onto the global indices. As the total is at least 2^64, distinct values are scaled
+    // onto distinct indices.
+    return totalVersions().scale(permutation.permute(n));
+}
+
+std::pair<size_t, VersionCount> VersionSampler::locate(const VersionCount& index) const {
+    // Find the last candidate whose versions start at or before the index.
+    auto it = std::upper_bound(prefixSums.begin(), prefixSums.end(), index) - 1;
+    return std::make_pair((size_t)(it - prefixSums.begin()), index - *it);
+}
+
+WeightedVersionSampler::WeightedVersionSampler(const std::vector<VersionCount>& versionCounts, unsigned seed)
+    : tree(versionCounts.size() + 1, 0), consumed(versionCounts.size(), 0) {
+    // Build the tree in linear time, by adding every node to its parent.
+    for (size_t iii = 1; iii < tree.size(); iii++) {
+        tree[iii] += versionCounts[iii - 1];
+        const size_t parent = iii + (iii & -iii);
+        if (parent < tree.size())
+            tree[parent] += tree[iii];
+        remaining += versionCounts[iii - 1];
+    }
+
+    // Every candidate permutes its versions with its own seed.
+    permutations.reserve(versionCounts.size());
+    for (size_t iii = 0; iii < versionCounts.size(); iii++)
+        permutations.emplace_back(std::vector<VersionCount>(1, versionCounts[iii]), seed + (unsigned)iii * 0x9E3779B9u);
+}
+
+size_t WeightedVersionSampler::find(VersionCount index) const {
+    // Descend the tree to find the first candidate whose remaining versions (in prefix) exceed the index.
+    size_t step = 1;
+    while (step * 2 < tree.size())
+        step *= 2;
+
+    size_t position = 0;
+    for (; step; step /= 2) {
+        if (position + step < tree.size() && tree[position + step] <= index) {
+            position += step;
+            index -= tree[position];
+        }
+    }
+    return position;
+}
+
+std::pair<size_t, VersionCount> WeightedVersionSampler::sample(RandomStream& random) {
+    const size_t candidate = find(random.random_below(remaining));
+
+    // One version less remains for the candidate.
+    for (size_t iii = candidate + 1; iii < tree.size(); iii += (iii & -iii))
+        tree[iii] -= 1;
+    remaining -= 1;
+
+    return std::make_pair(candidate, permutations[candidate].sample(consumed[candidate]++));
+}
+
+std::pair<size_t, VersionCount> VersionEnumerator::next() {
+    // Skip the candidates whose versions have all been visited.
+    while (candidate < versionCounts.size() && rank >= versionCounts[candidate]) {
+        candidate++;
+        rank = 0;
+    }
+
+    std::pair<size_t, VersionCount> version(candidate, rank);
+    rank += 1;
+    return version;
+}
+
+// Zero marks an empty slot, so it is stored as another value.
+static inline uint64_t slotValue(uint64_t fingerprint) {
+    return fingerprint ? fingerprint : 1;
+}
+
+bool FingerprintSet::insert(uint64_t fingerprint) {
+    const uint64_t value = slotValue(fingerprint);
+    const size_t mask = table.size() - 1;
+    for (size_t slot = value & mask; ; slot = (slot + 1) & mask) {
+        if (table[slot] == value)
+            return false;
+
+        if (table[slot] == 0) {
+            table[slot] = value;
+            if (++entries * 2 > table.size())
+                grow();
+            return true;
+        }
+    }
+}
+
+void FingerprintSet::grow() {
+    std::vector<uint64_t> old(table.size() * 2, 0);
+    old.swap(table);
+
+    const size_t mask = table.size() - 1;
+    for (auto value : old) {
+        if (value == 0)
+            continue;
+
+        size_t slot = value & mask;
+        while (table[slot] != 0)
+            slot = (slot + 1) & mask;
+        table[slot] = value;
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef _SEMANTIC_SAMPLER
+#define _SEMANTIC_SAMPLER
+
+#include "SemanticCount.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class RandomStream;
+
+// Method used to obtain the permutation of nrOfElements elements with a given rank (in lexicographic
+// order, rank 0 being the original ordering), by decoding the rank as a Lehmer code.
+std::vector<unsigned> unrank_permutation(unsigned nrOfElements, VersionCount rank);
+
+// A pseudo random permutation of [0, size), built from a Feistel network keyed by a seed. Values
+// that fall outside of the domain are encrypted again (cycle walking), so every index maps onto
+// a distinct value of the domain. A size of 0 stands for the full domain of 2^64 values.
+class FeistelPermutation {
+    private:
+        const uint64_t size;
+        const unsigned seed;
+        unsigned halfBits;// The number of bits in each half of the network
+        uint64_t mask;
+
+        uint64_t encrypt(uint64_t value) const;
+
+    public:
+        FeistelPermutation(uint64_t size, unsigned seed);
+
+        uint64_t permute(uint64_t index) const;
+};
+
+// This class samples distinct versions without rejection. The versions of all candidates are numbered
+// globally using the prefix sums of the number of versions of every candidate. Version k is the global
+// index at position k of a seeded permutation of all global indices, so computing a version is O(1) (and
+// O(log candidates) to locate the candidate), no version is ever drawn twice and nothing spins.
+// The version counts are arbitrary-precision, as a single candidate can have more than 2^64 versions.
+class VersionSampler {
+    private:
+        std::vector<VersionCount> prefixSums;// prefixSums[i] is the number of versions of the candidates before i
+        const FeistelPermutation permutation;
+
+    public:
+        VersionSampler(const std::vector<VersionCount>& versionCounts, unsigned seed);
+
+        const VersionCount& totalVersions() const {
+            return prefixSums.back();
+        }
+
+        // Get the global index of the n'th version (n < totalVersions()).
+        VersionCount sample(uint64_t n) const;
+
+        // Map a global index onto the candidate and the rank of the version within the versions of the candidate.
+        std::pair<size_t, VersionCount> locate(const VersionCount& index) const;
+};
+
+// This class samples versions in two steps: first a candidate is chosen with a probability proportional to
+// its number of versions that haven't been generated yet, then the next version from a seeded permutation of
+// the versions of the candidate is taken. The remaining counts are kept in a Fenwick tree, so both choosing a
+// candidate and consuming one of its versions are O(log candidates). As every candidate hands out its
+// versions without replacement, there are no duplicates to reject.
+class WeightedVersionSampler {
+    private:
+        std::vector<VersionCount> tree;// Fenwick tree of the remaining number of versions of every candidate (1-based)
+        VersionCount remaining;// The total remaining number of versions
+        std::vector<uint64_t> consumed;// The number of versions generated for every candidate
+        std::vector<VersionSampler> permutations;// The order in which every candidate hands out its versions
+
+        size_t find(VersionCount index) const;
+
+    public:
+        WeightedVersionSampler(const std::vector<VersionCount>& versionCounts, unsigned seed);
+
+        const VersionCount& remainingVersions() const {
+            return remaining;
+        }
+
+        // Choose the candidate and the rank of a version that wasn't sampled before. Requires remaining versions.
+        std::pair<size_t, VersionCount> sample(RandomStream& random);
+};
+
+// This class walks all versions of all candidates in order: the versions of the first candidate by rank, then
+// those of the second one, and so on. Every step is O(1) amortized.
+class VersionEnumerator {
+    private:
+        const std::vector<VersionCount>& versionCounts;
+        size_t candidate;// The candidate of the next version
+        VersionCount rank;// The rank of the next version within the versions of the candidate
+
+    public:
+        explicit VersionEnumerator(const std::vector<VersionCount>& versionCounts) : versionCounts(versionCounts), candidate(0), rank(0) {}
+
+        // Get the candidate and the rank of the next version. Must be called at most as many times as there are versions.
+        std::pair<size_t, VersionCount> next();
+};
+
+// A set of 64-bit fingerprints using open addressing with linear probing. The table is kept at most
+// half full, so lookups and insertions are O(1) on average.
+class FingerprintSet {
+    private:
+        std::vector<uint64_t> table;// Zero marks an empty slot
+        size_t entries;
+
+        void grow();
+
+    public:
+        FingerprintSet() : table(64, 0), entries(0) {}
+
+        // Insert a fingerprint. Returns false if the fingerprint was already in the set.
+        bool insert(uint64_t fingerprint);
+
+        size_t size() const {
+            return entries;
+        }
+};
+
+#endif
@@ -0,0 +1,106 @@
+// Test of the samplers that choose the versions. The domains are small enough to check every value: the
+// permutations must be bijections, unranking must invert ranking and the samplers must never repeat a version.
+
+#include "SemanticRandom.h"
+#include "SemanticSampler.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+static bool check(const std::string& name, bool condition) {
+    outs() << name << ": " << (condition ? "ok" : "failed") << "\n";
+    return condition;
+}
+
+// Compute the rank of a permutation (in lexicographic order) from its Lehmer code.
+static VersionCount rank_permutation(const std::vector<unsigned>& ordering) {
+    VersionCount rank(0);
+    for (size_t iii = 0; iii < ordering.size(); iii++) {
+        unsigned smaller = 0;
+        for (size_t jjj = iii + 1; jjj < ordering.size(); jjj++)
+            smaller += (ordering[jjj] < ordering[iii]);
+        rank *= ordering.size() - iii;
+        rank += smaller;
+    }
+    return rank;
+}
+
+// Check that the permutation maps [0, size) onto itself, for a number of seeds.
+static bool isBijection(uint64_t size) {
+    for (unsigned seed = 0; seed < 4; seed++) {
+        const FeistelPermutation permutation(size, seed);
+        std::vector<bool> seen(size, false);
+        for (uint64_t index = 0; index < size; index++) {
+            const uint64_t value = permutation.permute(index);
+            if (value >= size || seen[value])
+                return false;
+            seen[value] = true;
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool success = true;
+
+    // Every domain size up to 300 (odd and even numbers of bits, powers of two and one off), and a larger one.
+    bool bijections = true;
+    for (uint64_t size = 1; size <= 300; size++)
+        bijections = isBijection(size) && bijections;
+    success = check("permutation is a bijection", bijections && isBijection(5000)) && success;
+
+    // Unranking all permutations of 6 elements gives every permutation once, in lexicographic order.
+    bool roundTrips = true;
+    std::vector<unsigned> previous;
+    for (unsigned rank = 0; rank < 720; rank++) {
+        const std::vector<unsigned> ordering = unrank_permutation(6, VersionCount(rank));
+        roundTrips = roundTrips && rank_permutation(ordering) == VersionCount(rank) && (rank == 0 || previous < ordering);
+        previous = ordering;
+    }
+    success = check("unrank/rank round-trip", roundTrips) && success;
+
+    // Ranks beyond 64 bits: the last permutation of 25 elements is the reversed ordering.
+    VersionCount last(1);
+    for (uint32_t iii = 2; iii <= 25; iii++)
+        last *= iii;
+    last -= VersionCount(1);
+    const std::vector<unsigned> reversed = unrank_permutation(25, last);
+    bool isReversed = reversed.size() == 25;
+    for (unsigned iii = 0; iii < reversed.size(); iii++)
+        isReversed = isReversed && reversed[iii] == 24 - iii;
+    success = check("unrank beyond 64 bits", isReversed && rank_permutation(reversed) == last) && success;
+
+    // Sampling all versions of the candidates gives every version once.
+    const std::vector<VersionCount> versionCounts = {VersionCount(3), VersionCount(0), VersionCount(7), VersionCount(1)};
+    const VersionSampler sampler(versionCounts, 42);
+    std::set<std::pair<size_t, uint64_t>> versions;
+    for (uint64_t n = 0; n < 11; n++) {
+        const auto version = sampler.locate(sampler.sample(n));
+        if (version.second < versionCounts[version.first])
+            versions.insert(std::make_pair(version.first, version.second.toUInt64()));
+    }
+    success = check("sampler gives distinct versions", versions.size() == 11) && success;
+
+    // The weighted sampler never chooses a candidate without versions, and hands out every version once.
+    const std::vector<VersionCount> weights = {VersionCount(0), VersionCount(4), VersionCount(0), VersionCount(6), VersionCount(0)};
+    WeightedVersionSampler weightedSampler(weights, 7);
+    RandomStream random(7, 0);
+    std::set<std::pair<size_t, uint64_t>> weightedVersions;
+    bool respectsZeroWeights = true;
+    for (unsigned iii = 0; iii < 10; iii++) {
+        const auto version = weightedSampler.sample(random);
+        respectsZeroWeights = respectsZeroWeights && weights[version.first] > version.second;
+        weightedVersions.insert(std::make_pair(version.first, version.second.toUInt64()));
+    }
+    success = check("weighted sampling respects zero weights", respectsZeroWeights) && success;
+    success = check("weighted sampling gives distinct versions", weightedVersions.size() == 10 && weightedSampler.remainingVersions().isZero()) && success;
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include "SemanticScheduler.h"
+#include "SemanticUtil.h"
+
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned size) : next(0) {
+    if (size == 0)
+        size = 1;
+
+    for (unsigned iii = 0; iii < size; iii++)
+        workers.emplace_back(new Worker());
+}
+
+void WorkStealingPool::add(Task task) {
+    workers[next]->tasks.push_back(std::move(task));
+    next = (next + 1) % workers.size();
+}
+
+void WorkStealingPool::add(Task task, unsigned worker) {
+    workers[worker % workers.size()]->pinned.push_back(std::move(task));
+}
+
+bool WorkStealingPool::take(unsigned worker, Task& task) {
+    Worker& own = *workers[worker];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.pinned.empty()) {
+        task = std::move(own.pinned.front());
+        own.pinned.pop_front();
+        return true;
+    }
+    if (own.tasks.empty())
+        return false;
+
+    task = std::move(own.tasks.front());
+    own.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned thief, Task& task) {
+    for (unsigned iii = 1; iii < workers.size(); iii++) {
+        Worker& victim = *workers[(thief + iii) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty())
+            continue;
+
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::work(unsigned worker) {
+    // No tasks are added while running, so a worker is done once all deques are empty.
+    Task task;
+    // The messages of a task are buffered even on a single worker, as other pipeline stages log concurrently.
+    while (take(worker, task) || steal(worker, task)) {
+        LogBuffer buffer;
+        task(worker);
+    }
+}
+
+void WorkStealingPool::run() {
+    if (workers.size() == 1) {
+        work(0);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned iii = 0; iii < workers.size(); iii++)
+        threads.emplace_back(&WorkStealingPool::work, this, iii);
+    for (auto& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,50 @@
+#ifndef _SEMANTIC_SCHEDULER
+#define _SEMANTIC_SCHEDULER
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// This class executes tasks on a pool of workers. Every worker has a deque of tasks: it takes tasks from
+// the front of its own deque and, when that one is empty, steals tasks from the back of the others. This
+// way a few large tasks on one worker don't serialize the run. With a single worker, all tasks are executed
+// on the calling thread. A task can also be pinned to a worker, e.g. because that worker holds the AST
+// the task needs. Pinned tasks are never stolen, and a worker executes its pinned tasks first.
+class WorkStealingPool {
+    public:
+        typedef std::function<void(unsigned worker)> Task;// A task receives the index of the worker executing it
+
+    private:
+        struct Worker {
+            std::mutex lock;
+            std::deque<Task> tasks;
+            std::deque<Task> pinned;// The tasks only this worker may execute
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        unsigned next;// The worker that receives the next task
+
+        bool take(unsigned worker, Task& task);
+        bool steal(unsigned thief, Task& task);
+        void work(unsigned worker);
+
+    public:
+        explicit WorkStealingPool(unsigned size);
+
+        unsigned size() const {
+            return workers.size();
+        }
+
+        // Add a task. The tasks are distributed over the workers in a round-robin fashion.
+        void add(Task task);
+
+        // Add a task that is executed by the given worker.
+        void add(Task task, unsigned worker);
+
+        // Execute all tasks, and wait until they are finished.
+        void run();
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "SemanticSerialization.h"
+
+#include "llvm/Support/Endian.h"
+
+#include <cstring>
+
+using namespace llvm::support;
+
+void BinaryWriter::writeU32(uint32_t value) {
+    char bytes[sizeof(value)];
+    endian::write32le(bytes, value);
+    buffer.append(bytes, sizeof(bytes));
+}
+
+void BinaryWriter::writeU64(uint64_t value) {
+    char bytes[sizeof(value)];
+    endian::write64le(bytes, value);
+    buffer.append(bytes, sizeof(bytes));
+}
+
+void BinaryWriter::writeBool(bool value) {
+    buffer.push_back(value ? 1 : 0);
+}
+
+void BinaryWriter::writeString(const std::string& value) {
+    writeU32(value.size());
+    buffer.append(value);
+}
+
+void BinaryWriter::writeStrings(const std::set<std::string>& values) {
+    writeU32(values.size());
+    for (const auto& value : values)
+        writeString(value);
+}
+
+bool BinaryReader::read(void* destination, size_t size) {
+    if (failed || (size_t)(end - position) < size) {
+        failed = true;
+        return false;
+    }
+
+    memcpy(destination, position, size);
+    position += size;
+    return true;
+}
+
+uint32_t BinaryReader::readU32() {
+    char bytes[sizeof(uint32_t)];
+    return read(bytes, sizeof(bytes)) ? endian::read32le(bytes) : 0;
+}
+
+uint64_t BinaryReader::readU64() {
+    char bytes[sizeof(uint64_t)];
+    return read(bytes, sizeof(bytes)) ? endian::read64le(bytes) : 0;
+}
+
+bool BinaryReader::readBool() {
+    char value = 0;
+    read(&value, sizeof(value));
+    return value != 0;
+}
+
+std::string BinaryReader::readString() {
+    const uint32_t size = readU32();
+    if (failed || (size_t)(end - position) < size) {
+        failed = true;
+        return std::string();
+    }
+
+    std::string value(position, size);
+    position += size;
+    return value;
+}
+
+std::set<std::string> BinaryReader::readStrings() {
+    std::set<std::string> values;
+    const uint32_t size = readU32();
+    for (uint32_t iii = 0; iii < size && !failed; iii++)
+        values.insert(readString());
+    return values;
+}
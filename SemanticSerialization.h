@@ -0,0 +1,57 @@
+#ifndef _SEMANTIC_SERIALIZATION
+#define _SEMANTIC_SERIALIZATION
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <set>
+#include <string>
+
+// This class serializes values into a compact binary buffer. Integers are stored in little-endian byte
+// order, so the buffers can be read back on any machine.
+class BinaryWriter {
+    private:
+        std::string buffer;
+
+    public:
+        void writeU32(uint32_t value);
+        void writeU64(uint64_t value);
+        void writeBool(bool value);
+        void writeString(const std::string& value);
+        void writeStrings(const std::set<std::string>& values);
+
+        const std::string& data() const {
+            return buffer;
+        }
+};
+
+// This class reads back the values written by a BinaryWriter. Reading past the end of the buffer
+// doesn't crash, but marks the reader as failed and returns default values.
+class BinaryReader {
+    private:
+        const char* position;
+        const char* end;
+        bool failed;
+
+        bool read(void* destination, size_t size);
+
+    public:
+        explicit BinaryReader(llvm::StringRef data) : position(data.begin()), end(data.end()), failed(false) {}
+
+        uint32_t readU32();
+        uint64_t readU64();
+        bool readBool();
+        std::string readString();
+        std::set<std::string> readStrings();
+
+        // Whether all reads so far succeeded.
+        bool ok() const {
+            return !failed;
+        }
+
+        bool atEnd() const {
+            return position == end;
+        }
+};
+
+#endif
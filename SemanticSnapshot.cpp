@@ -0,0 +1,216 @@
+#include "SemanticSnapshot.h"
+#include "SemanticSerialization.h"
+#include "SemanticUtil.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iterator>
+#include <tuple>
+#include <vector>
+
+using namespace clang;
+using namespace llvm;
+
+static const uint32_t SnapshotMagic = 0x53414d53;// "SMAS"
+static const uint32_t SnapshotFormat = 2;
+
+// Write a file by writing a temporary file and renaming it, so readers never see a partial file.
+static bool writeAtomically(const std::string& path, StringRef contents) {
+    SmallString<256> temporaryPath;
+    int FD;
+    if (sys::fs::createUniqueFile(path + "-%%%%%%.tmp", FD, temporaryPath))
+        return false;
+
+    {
+        raw_fd_ostream stream(FD, /*shouldClose=*/true);
+        stream << contents;
+    }
+    return !sys::fs::rename(temporaryPath, path);
+}
+
+// Update the modification time of a snapshot, which is used to find the least recently used ones.
+static void touch(const std::string& path) {
+    int FD;
+    if (sys::fs::openFileForWrite(path, FD, sys::fs::F_Append))
+        return;
+    sys::fs::setLastModificationAndAccessTime(FD, sys::toTimePoint(std::time(nullptr)));
+    sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+// Get the size and the identity of the AST file of a snapshot. They are recorded with its dependencies, so the
+// dependencies can't be taken for those of another AST file. Returns false if the AST file doesn't exist.
+static bool getASTIdentity(const std::string& path, uint64_t& size, sys::fs::UniqueID& id) {
+    sys::fs::file_status status;
+    if (sys::fs::status(path, status))
+        return false;
+    size = status.getSize();
+    id = status.getUniqueID();
+    return true;
+}
+
+ASTSnapshotStore::ASTSnapshotStore(const tooling::CompilationDatabase& compilations, const std::string& directory, unsigned long capacity)
+    : compilations(compilations), directory(directory), capacity(capacity), PCHContainerOps(std::make_shared<PCHContainerOperations>()), total(0) {
+    sys::fs::create_directories(directory);
+
+    // Find the snapshots of earlier runs, with their size and the last time they were used.
+    std::vector<std::tuple<sys::TimePoint<>, uint64_t, std::string>> existing;
+    std::error_code error;
+    for (sys::fs::directory_iterator it(directory, error), end; it != end && !error; it.increment(error)) {
+        if (sys::path::extension(it->path()) != ".ast")
+            continue;
+
+        sys::fs::file_status status;
+        if (sys::fs::status(it->path(), status))
+            continue;
+        const std::string& path = it->path();
+        existing.emplace_back(status.getLastModificationTime(), status.getSize(), path.substr(0, path.size() - 4));
+    }
+
+    std::sort(existing.begin(), existing.end());
+    for (const auto& snapshot : existing)
+        use(std::get<2>(snapshot), std::get<1>(snapshot));
+}
+
+void ASTSnapshotStore::use(const std::string& basePath, uint64_t size) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = snapshots.find(basePath);
+    if (it != snapshots.end()) {
+        recency.erase(it->second.first);
+        total -= it->second.second;
+    }
+    recency.push_back(basePath);
+    snapshots[basePath] = std::make_pair(std::prev(recency.end()), size);
+    total += size;
+}
+
+std::string ASTSnapshotStore::getBasePath(const std::string& sourcePath) const {
+    std::string name;
+    raw_string_ostream stream(name);
+    stream << format_hex_no_prefix(xxHash64(sourcePath), 16) << "-" << sys::path::stem(sourcePath);
+    stream.flush();
+
+    SmallString<256> path(directory);
+    sys::path::append(path, name);
+    return path.str();
+}
+
+std::unique_ptr<ASTUnit> ASTSnapshotStore::load(const std::string& sourcePath) {
+    const std::string basePath = getBasePath(sourcePath);
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(basePath + ".deps");
+    if (!buffer)
+        return nullptr;
+
+    // Check whether the snapshot is still up to date, and whether the dependencies belong to the AST file. A
+    // save that was interrupted may have left the AST file of one run with the dependencies of another.
+    BinaryReader reader((*buffer)->getBuffer());
+    if (reader.readU32() != SnapshotMagic || reader.readU32() != SnapshotFormat || reader.readString() != getClangFullVersion()
+        || reader.readString() != sourcePath || reader.readU64() != CandidateDatabase::hashCompileCommands(compilations, sourcePath))
+        return nullptr;
+
+    uint64_t size;
+    sys::fs::UniqueID id;
+    if (!getASTIdentity(basePath + ".ast", size, id) || reader.readU64() != size || reader.readU64() != id.getDevice()
+        || reader.readU64() != id.getFile())
+        return nullptr;
+
+    const uint32_t nrOfDependencies = reader.readU32();
+    for (uint32_t iii = 0; iii < nrOfDependencies && reader.ok(); iii++) {
+        const std::string dependency = reader.readString();
+        uint64_t hash;
+        if (!fileHashes.get(dependency, hash) || hash != reader.readU64())
+            return nullptr;
+    }
+    if (!reader.ok())
+        return nullptr;
+
+    IntrusiveRefCntPtr<DiagnosticsEngine> diagnostics = CompilerInstance::createDiagnostics(new DiagnosticOptions());
+    std::unique_ptr<ASTUnit> unit = ASTUnit::LoadFromASTFile(basePath + ".ast", PCHContainerOps->getRawReader(), ASTUnit::LoadEverything,
+            diagnostics, FileSystemOptions());
+    if (unit) {
+        touch(basePath + ".ast");
+        use(basePath, size);
+    }
+    return unit;
+}
+
+void ASTSnapshotStore::save(const std::string& sourcePath, ASTUnit& unit) {
+    BinaryWriter writer;
+    writer.writeU32(SnapshotMagic);
+    writer.writeU32(SnapshotFormat);
+    writer.writeString(getClangFullVersion());
+    writer.writeString(sourcePath);
+    writer.writeU64(CandidateDatabase::hashCompileCommands(compilations, sourcePath));
+
+    const std::set<std::string> dependencies = getDependencies(unit.getSourceManager());
+    std::vector<uint64_t> hashes;
+    for (const auto& dependency : dependencies) {
+        uint64_t hash;
+        if (!fileHashes.get(dependency, hash))
+            return;
+        hashes.push_back(hash);
+    }
+
+    // The dependencies of the previous snapshot are removed first and the new ones are written last, once the
+    // AST is in place. An interrupted save thus leaves an AST without dependencies, which is never loaded.
+    const std::string basePath = getBasePath(sourcePath);
+    SmallString<256> temporaryPath;
+    if (sys::fs::createUniqueFile(basePath + "-%%%%%%.tmp", temporaryPath))
+        return;
+    sys::fs::remove(basePath + ".deps");
+    if (unit.Save(temporaryPath.str()) || sys::fs::rename(temporaryPath, basePath + ".ast")) {
+        logs() << "Error saving AST snapshot of: " << sourcePath << "\n";
+        sys::fs::remove(temporaryPath);
+        return;
+    }
+
+    uint64_t size;
+    sys::fs::UniqueID id;
+    if (!getASTIdentity(basePath + ".ast", size, id))
+        return;
+    writer.writeU64(size);
+    writer.writeU64(id.getDevice());
+    writer.writeU64(id.getFile());
+    writer.writeU32(dependencies.size());
+    auto hash = hashes.begin();
+    for (const auto& dependency : dependencies) {
+        writer.writeString(dependency);
+        writer.writeU64(*hash++);
+    }
+    if (!writeAtomically(basePath + ".deps", writer.data()))
+        return;
+
+    use(basePath, size);
+    evict();
+}
+
+void ASTSnapshotStore::evict() {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Remove the least recently used snapshots until they fit. The most recently used one is kept, even when it
+    // doesn't fit by itself.
+    while (total > capacity && recency.size() > 1) {
+        const std::string basePath = recency.front();
+        logs() << "Evicting AST snapshot: " << basePath << ".ast\n";
+        sys::fs::remove(basePath + ".deps");
+        sys::fs::remove(basePath + ".ast");
+
+        recency.pop_front();
+        auto it = snapshots.find(basePath);
+        total -= it->second.second;
+        snapshots.erase(it);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef _SEMANTIC_SNAPSHOT
+#define _SEMANTIC_SNAPSHOT
+
+#include "SemanticDatabase.h"
+
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// This class keeps serialized ASTs of translation units in a directory, so later runs can load an AST
+// instead of parsing the translation unit again. Next to every snapshot, a small file records what the
+// AST depends on: the version of clang, the compile commands of the translation unit and the content
+// hashes of all files it included, and the size and identity of the AST file it belongs to. A snapshot is
+// only loaded when all of these are unchanged. When the snapshots take more space than the capacity, the
+// least recently used ones are removed. The store keeps the sizes and the order of use of the snapshots in
+// memory, so the directory is only listed once. The store can be used by multiple threads.
+class ASTSnapshotStore {
+    private:
+        const clang::tooling::CompilationDatabase& compilations;
+        const std::string directory;
+        const unsigned long capacity;// In bytes.
+        std::shared_ptr<clang::PCHContainerOperations> PCHContainerOps;// The loaded ASTs keep a reference to its reader
+        ContentHashes fileHashes;
+        std::mutex lock;
+        std::list<std::string> recency;// The base paths of the snapshots, the least recently used one first
+        std::map<std::string, std::pair<std::list<std::string>::iterator, uint64_t>> snapshots;// The position in recency and the size, by base path
+        uint64_t total;// The size of all snapshots
+
+        // The path of the snapshot of a translation unit, without extension.
+        std::string getBasePath(const std::string& sourcePath) const;
+
+        // Mark a snapshot as the most recently used one, with its current size.
+        void use(const std::string& basePath, uint64_t size);
+        void evict();
+
+    public:
+        ASTSnapshotStore(const clang::tooling::CompilationDatabase& compilations, const std::string& directory, unsigned long capacity);
+
+        // Load the snapshot of a translation unit. Returns nullptr if there is no up to date snapshot.
+        std::unique_ptr<clang::ASTUnit> load(const std::string& sourcePath);
+
+        // Store the snapshot of a translation unit, replacing the previous one.
+        void save(const std::string& sourcePath, clang::ASTUnit& unit);
+};
+
+#endif
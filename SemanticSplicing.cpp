@@ -0,0 +1,128 @@
+#include "SemanticSplicing.h"
+#include "SemanticOutput.h"
+#include "SemanticUtil.h"
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <memory>
+
+using namespace clang;
+using namespace llvm;
+
+bool SourceSite::addSlice(const clang::SourceRange& range, const std::string& text, const clang::ASTContext& astContext) {
+    const SourceManager& sm = astContext.getSourceManager();
+
+    // The rewriter can only modify ranges that are written in a file.
+    if (!range.getBegin().isFileID() || !range.getEnd().isFileID())
+        return false;
+
+    const SourceLocation end = Lexer::getLocForEndOfToken(range.getEnd(), 0, sm, astContext.getLangOpts());
+    if (end.isInvalid() || sm.getFileID(range.getBegin()) != sm.getFileID(end))
+        return false;
+
+    // All slices of a site are in the same file.
+    const std::string name = sm.getFilename(range.getBegin()).str();
+    if (slices.empty())
+        fileName = name;
+    else if (fileName != name)
+        return false;
+
+    const unsigned offset = sm.getFileOffset(range.getBegin());
+    slices.emplace_back(offset, sm.getFileOffset(end) - offset, text);
+    return true;
+}
+
+void SourceSite::serialize(BinaryWriter& writer) const {
+    writer.writeString(fileName);
+    writer.writeString(newItem);
+    writer.writeString(separatorBefore);
+    writer.writeString(separatorAfter);
+    writer.writeU32(slices.size());
+    for (const auto& slice : slices) {
+        writer.writeU32(slice.offset);
+        writer.writeU32(slice.length);
+        writer.writeString(slice.text);
+    }
+}
+
+SourceSite SourceSite::deserialize(BinaryReader& reader) {
+    const std::string fileName = reader.readString();
+    const std::string newItem = reader.readString();
+    const std::string separatorBefore = reader.readString();
+    const std::string separatorAfter = reader.readString();
+    SourceSite site(newItem, separatorBefore, separatorAfter);
+    site.fileName = fileName;
+
+    const uint32_t nrOfSlices = reader.readU32();
+    for (uint32_t iii = 0; iii < nrOfSlices && reader.ok(); iii++) {
+        const unsigned offset = reader.readU32();
+        const unsigned length = reader.readU32();
+        site.slices.emplace_back(offset, length, reader.readString());
+    }
+    return site;
+}
+
+bool spliceVersion(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, std::map<std::string, std::vector<SourceEdit>>& edits) {
+    // Every file is read and checked before anything is written, so a version is never left half spliced.
+    std::vector<std::unique_ptr<MemoryBuffer>> buffers;
+    for (auto& it : edits) {
+        const std::string& fileName = it.first;
+        std::vector<SourceEdit>& fileEdits = it.second;
+
+        // Map the original file.
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(fileName);
+        if (!buffer)
+        {
+            logs() << "Error reading file: " << fileName << "\n";
+            return false;
+        }
+        const StringRef original = (*buffer)->getBuffer();
+
+        // The edits must be in the file, and can't overlap.
+        std::sort(fileEdits.begin(), fileEdits.end());
+        unsigned position = 0;
+        for (const auto& edit : fileEdits) {
+            if (edit.offset < position || edit.offset + edit.length > original.size())
+            {
+                logs() << "Error splicing file: " << fileName << "\n";
+                return false;
+            }
+            position = edit.offset + edit.length;
+        }
+        buffers.push_back(std::move(*buffer));
+    }
+
+    size_t index = 0;
+    for (const auto& it : edits) {
+        const std::string& fileName = it.first;
+        const std::vector<SourceEdit>& fileEdits = it.second;
+        const StringRef original = buffers[index++]->getBuffer();
+
+        // In patch mode only the diff of the file is derived from the edits.
+        if (output.patch) {
+            if (!addPatchToOutput(output, baseDirectory, version, fileName, original, fileEdits))
+                return false;
+            continue;
+        }
+
+        // Apply the edits from front to back, copying the original text in between.
+        std::string contents;
+        contents.reserve(original.size());
+        unsigned position = 0;
+        for (const auto& edit : fileEdits) {
+            contents.append(original.data() + position, edit.offset - position);
+            contents.append(edit.replacement);
+            position = edit.offset + edit.length;
+        }
+        contents.append(original.data() + position, original.size() - position);
+
+        if (!writeFileToOutput(output, outputPath, baseDirectory, version, fileName, std::move(contents)))
+            return false;
+    }
+
+    return true;
+}
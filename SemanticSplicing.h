@@ -0,0 +1,68 @@
+#ifndef _SEMANTIC_SPLICING
+#define _SEMANTIC_SPLICING
+
+#include "SemanticSerialization.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceLocation.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class VersionOutput;
+
+// A slice of a source file, e.g. a field declaration or a call argument.
+struct SourceSlice {
+    unsigned offset;
+    unsigned length;
+    std::string text;// The text of the item when it is moved to another position
+
+    SourceSlice(unsigned offset, unsigned length, const std::string& text) : offset(offset), length(length), text(text) {}
+};
+
+// A site in a source file at which a transformation is applied, e.g. the fields of a struct
+// definition, the parameters of a function declaration or the arguments of a call.
+struct SourceSite {
+    std::string fileName;
+    std::vector<SourceSlice> slices;
+    std::string newItem;// The item that is inserted by an insertion transformation
+    std::string separatorBefore;// Separator used when inserting before a slice
+    std::string separatorAfter;// Separator used when inserting after the last slice
+
+    SourceSite(const std::string& newItem, const std::string& separatorBefore, const std::string& separatorAfter)
+        : newItem(newItem), separatorBefore(separatorBefore), separatorAfter(separatorAfter) {}
+
+    // Add the slice for a source range. Returns false if the range can't be spliced (e.g. it is part of a macro).
+    bool addSlice(const clang::SourceRange& range, const std::string& text, const clang::ASTContext& astContext);
+
+    // Write the site to, or read it back from a candidate database.
+    void serialize(BinaryWriter& writer) const;
+    static SourceSite deserialize(BinaryReader& reader);
+
+    bool operator< (const SourceSite& other) const
+    {
+        if (fileName != other.fileName)
+            return fileName < other.fileName;
+        if (slices.size() != other.slices.size())
+            return slices.size() < other.slices.size();
+        return !slices.empty() && (slices.front().offset < other.slices.front().offset);
+    }
+};
+
+// An edit to a source file: replace the range [offset, offset + length) by the replacement.
+struct SourceEdit {
+    unsigned offset;
+    unsigned length;
+    std::string replacement;
+
+    SourceEdit(unsigned offset, unsigned length, const std::string& replacement) : offset(offset), length(length), replacement(replacement) {}
+    bool operator< (const SourceEdit& other) const { return offset < other.offset; }
+};
+
+// Method used to generate a version by applying edits to the original files, without invoking clang.
+// The edits are applied to memory mapped copies of the original files. All files are checked before any
+// of them is written. Returns false if one of the files could not be read or the edits overlap.
+bool spliceVersion(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, std::map<std::string, std::vector<SourceEdit>>& edits);
+
+#endif
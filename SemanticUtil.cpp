@@ -1,15 +1,40 @@
 #include "SemanticUtil.h"
+#include "SemanticOutput.h"
+#include "SemanticOverlay.h"
 
 #include "clang/Lex/Lexer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <cmath>
 #include <cstdlib> // rand
-#include <fstream>
+#include <cstring>
+#include <mutex>
 #include <numeric>
-#include <random>
 #include <sstream>
 
+static thread_local llvm::raw_ostream* threadLog = nullptr;
+static std::mutex logMutex;
+
+llvm::raw_ostream& logs() {
+    return threadLog ? *threadLog : llvm::outs();
+}
+
+LogBuffer::LogBuffer() : stream(buffer), previous(threadLog) {
+    threadLog = &stream;
+}
+
+LogBuffer::~LogBuffer() {
+    threadLog = previous;
+    stream.flush();
+
+    std::lock_guard<std::mutex> guard(logMutex);
+    logs() << buffer;
+}
+
 // Obtain source information corresponding to a statement.
 std::string location2str(const clang::SourceRange& range, const clang::ASTContext& astContext) {
     const clang::SourceManager& sm = astContext.getSourceManager();
@@ -19,72 +44,207 @@ std::string location2str(const clang::SourceRange& range, const clang::ASTContex
     return std::string(Start, End - Start);
 }
 
-static std::mt19937 generator;
-
-void init_random(unsigned seed) {
-    generator.seed(seed);
+std::set<std::string> getDependencies(const clang::SourceManager& sm) {
+    std::set<std::string> dependencies;
+    for (auto it = sm.fileinfo_begin(); it != sm.fileinfo_end(); ++it) {
+        llvm::SmallString<256> path(it->first->getName());
+        llvm::sys::fs::make_absolute(path);
+        dependencies.insert(path.str());
+    }
+    return dependencies;
 }
 
-unsigned random_0_to_n(const unsigned n) {
-    std::uniform_int_distribution<unsigned> distribution(0, n);
+std::string getMainFilePath(const clang::SourceManager& sm) {
+    llvm::SmallString<256> path(sm.getFileEntryForID(sm.getMainFileID())->getName());
+    sm.getFileManager().makeAbsolutePath(path);
+    llvm::sys::path::remove_dots(path);
+    return path.str();
+}
 
-    return distribution(generator);
+// The options whose value is a path, either joined to the option or as the next argument.
+static const char* const PathOptions[] = { "-I", "-F", "-isystem", "-iquote", "-idirafter", "-include", "-imacros", "-isysroot", "--sysroot=", "-ivfsoverlay" };
+
+bool usesAbsolutePaths(const clang::tooling::CompilationDatabase& compilations, const std::vector<std::string>& sourcePaths, std::string& reason) {
+    for (const auto& sourcePath : sourcePaths) {
+        for (const auto& command : compilations.getCompileCommands(sourcePath)) {
+            if (!llvm::sys::path::is_absolute(command.Directory)) {
+                reason = "the directory of " + sourcePath + " is relative: " + command.Directory;
+                return false;
+            }
+            if (!llvm::sys::path::is_absolute(command.Filename)) {
+                reason = "the file of " + sourcePath + " is relative: " + command.Filename;
+                return false;
+            }
+
+            for (size_t iii = 1; iii < command.CommandLine.size(); iii++) {
+                const llvm::StringRef argument = command.CommandLine[iii];
+                for (const char* option : PathOptions) {
+                    if (!argument.startswith(option))
+                        continue;
+
+                    // The value is joined to the option, or it is the next argument.
+                    std::string value = argument.substr(strlen(option)).str();
+                    if (value.empty() && iii + 1 < command.CommandLine.size() && !llvm::StringRef(option).endswith("="))
+                        value = command.CommandLine[++iii];
+                    if (!value.empty() && !llvm::sys::path::is_absolute(value)) {
+                        reason = "an include path of " + sourcePath + " is relative: " + value;
+                        return false;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    return true;
 }
 
-const std::vector<unsigned> generate_random_ordering(unsigned nrOfElements)
+VersionCount factorial(unsigned n)
 {
-    // Create original ordering
-    std::vector<unsigned> ordering(nrOfElements);
-    std::iota(ordering.begin(), ordering.end(), 0);
+    VersionCount result(1);
+    for (unsigned iii = 2; iii <= n; iii++)
+        result *= iii;
+    return result;
+}
 
-    // Make sure the modified ordering isn't the same as the original
-    std::vector<unsigned> original_ordering = ordering;
-    do {
-        std::shuffle(ordering.begin(), ordering.end(), generator);
-    } while (original_ordering == ordering);
+double entropyEquiprobable(const VersionCount& m) {
+    return m.log2();
+}
 
-    return ordering;
+// Construct the output directory of a version.
+std::string getVersionDirectory(const std::string& outputPath, long version) {
+    std::stringstream s;
+    s << outputPath << "v" << version;
+    return s.str();
 }
 
-unsigned long factorial(unsigned long n)
-{
-  return (n == 1 || n == 0) ? 1 : factorial(n - 1) * n;
+void writeJSONToFile(OutputWriter& writer, std::string outputPath, int version, std::string fileName, Json::Value output) {
+
+    // We construct the full output directory.
+    std::string fullPath = (version != -1) ? getVersionDirectory(outputPath, version) : outputPath;
+
+    // Write changes to the file.
+    std::string outputPathFull = fullPath + "/" + fileName;
+
+    logs() << "Output path: " << outputPathFull << "\n";
+
+    // Writer used to write JSON to output file.
+    Json::StyledWriter styledWriter;
+    writer.write(OutputFile(outputPathFull, version, fileName, styledWriter.write(output)));
 }
 
-double entropyEquiprobable(long m) {
-    return log2(m);
+std::string getRelativePath(const std::string& fileName, const std::string& baseDirectory) {
+    std::string relativePath = fileName.substr(fileName.find(baseDirectory) + baseDirectory.length()); /* until the end automatically... */
+    relativePath.erase(0, relativePath.find_first_not_of("/\\"));
+    return relativePath;
 }
 
-void writeJSONToFile(std::string outputPath, int version, std::string fileName, Json::Value output) {
+// Hand a file of a version to the output writer. The contents are moved into the writer, not copied.
+static bool writeFile(VersionOutput& output, const std::string& fullPath, const std::string& baseDirectory, unsigned long version, const std::string& fileNameStr, std::string contents) {
+    logs() << "Obtained filename: " << fileNameStr << "\n";
+    std::string fileName = getRelativePath(fileNameStr, baseDirectory);
 
-    // We construct the full output directory.
-    std::string fullPath;
-    if (version != -1) {
-        std::stringstream s;
-        s << outputPath << "v" << version;
-        fullPath = s.str();
-    } else {
-        fullPath = outputPath;
+    if (output.overlay)
+        output.overlays.add(version, fileName, std::string());
+
+    // Write changes to the file.
+    std::string outputPath = fullPath + "/" + fileName;
+    return output.writer.write(OutputFile(outputPath, version, fileName, std::move(contents)));
+}
+
+// Check whether a file still has to be written for a version. Translation units of the same version (that can
+// be rewritten concurrently) write a header they share only once.
+static bool claimFile(VersionOutput& output, unsigned long version, const llvm::sys::fs::UniqueID& file, const std::string& fileName, llvm::StringRef contents) {
+    switch (output.registry.claim(version, file, llvm::xxHash64(contents))) {
+        case OutputRegistry::New:
+            return true;
+        case OutputRegistry::Duplicate:
+            logs() << "Skipping identical rewrite of: " << fileName << "\n";
+            return false;
+        case OutputRegistry::Conflict:
+            logs() << "Conflict: translation units of version " << version << " rewrote " << fileName << " differently, keeping the first rewrite\n";
+            return false;
     }
+    return false;
+}
 
-    // We check if this directory exists, if it doesn't we will create it.
-    const int dir_err = system(("mkdir -p " + fullPath).c_str());
+// Add the diff of a file to the patch of a version.
+static void addPatch(VersionOutput& output, const std::string& baseDirectory, unsigned long version, const llvm::sys::fs::UniqueID& file, const std::string& fileName,
+        llvm::StringRef original, const std::vector<SourceEdit>& edits) {
+    const std::string relativePath = getRelativePath(fileName, baseDirectory);
+    std::string diff = makeUnifiedDiff(relativePath, original, edits);
+    if (claimFile(output, version, file, fileName, diff))
+        output.patches.add(version, relativePath, std::move(diff));
+}
 
-    // Output stream.
-    std::ofstream outputFile;
+void writeChangesToOutput(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, RecordingRewriter& rewriter) {
+    const std::string fullPath = getVersionDirectory(outputPath, version);
+
+    // Debug
+    logs() << "Full path: " << fullPath << "\n";
+
+    // We write the results to a new location.
+    for (clang::Rewriter::buffer_iterator I = rewriter.buffer_begin(), E = rewriter.buffer_end(); I != E; ++I) {
+        const clang::FileEntry* entry = rewriter.getSourceMgr().getFileEntryForID(I->first);
+        const std::string fileName = entry->getName().str();
+
+        // In patch mode the diff is derived from the recorded edits, the rewritten file isn't built.
+        const std::vector<SourceEdit>* edits = rewriter.getEdits(I->first);
+        if (output.patch && edits) {
+            addPatch(output, baseDirectory, version, entry->getUniqueID(), fileName, rewriter.getSourceMgr().getBufferData(I->first), *edits);
+            continue;
+        }
+
+        std::string contents;
+        contents.reserve(I->second.size());
+        contents.assign(I->second.begin(), I->second.end());
+        if (!claimFile(output, version, entry->getUniqueID(), fileName, contents))
+            continue;
+        if (!writeFile(output, fullPath, baseDirectory, version, fileName, std::move(contents)))
+            return;
+    }
+}
 
-    // Write changes to the file.
-    std::string outputPathFull = fullPath + "/" + fileName;
+bool writeFileToOutput(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, const std::string& fileName, std::string contents) {
+    llvm::sys::fs::UniqueID file;
+    if (!llvm::sys::fs::getUniqueID(fileName, file) && !claimFile(output, version, file, fileName, contents))
+        return true;
 
-    llvm::outs() << "Output path: " << outputPathFull << "\n";
+    return writeFile(output, getVersionDirectory(outputPath, version), baseDirectory, version, fileName, std::move(contents));
+}
 
-    // We open the file.
-    outputFile.open(outputPathFull.c_str());
+bool addPatchToOutput(VersionOutput& output, const std::string& baseDirectory, unsigned long version, const std::string& fileName, llvm::StringRef original, const std::vector<SourceEdit>& edits) {
+    llvm::sys::fs::UniqueID file;
+    if (std::error_code error = llvm::sys::fs::getUniqueID(fileName, file)) {
+        logs() << "Error reading file: " << fileName << "\n";
+        return false;
+    }
 
-    // Writer used to write JSON to output file.
-    Json::StyledWriter styledWriter;
-    outputFile << styledWriter.write(output);
+    addPatch(output, baseDirectory, version, file, fileName, original, edits);
+    return true;
+}
+
+void writePatchToOutput(VersionOutput& output, const std::string& outputPath, unsigned long version) {
+    std::string patch;
+    for (const auto& diff : output.patches.take(version))
+        patch += diff.second;
+    if (patch.empty())
+        return;
+
+    const std::string fullPath = getVersionDirectory(outputPath, version);
+    output.writer.write(OutputFile(fullPath + "/version.patch", version, "version.patch", std::move(patch)));
+}
 
-    // We close the file.
-    outputFile.close();
+void writeOverlayToOutput(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, const std::vector<clang::tooling::CompileCommand>& commands) {
+    // The paths in the overlay and the database have to be absolute, builds don't run in our directory.
+    llvm::SmallString<256> absoluteOutputPath(outputPath);
+    llvm::SmallString<256> absoluteBaseDirectory(baseDirectory);
+    llvm::sys::fs::make_absolute(absoluteOutputPath);
+    llvm::sys::fs::make_absolute(absoluteBaseDirectory);
+    const std::string versionDirectory = getVersionDirectory(std::string(absoluteOutputPath.str()), version);
+
+    std::set<std::string> files;
+    for (const auto& file : output.overlays.take(version))
+        files.insert(file.first);
+    writeJSONToFile(output.writer, outputPath, version, "vfsoverlay.yaml", makeVFSOverlay(std::string(absoluteBaseDirectory.str()), versionDirectory, files));
+    writeJSONToFile(output.writer, outputPath, version, "compile_commands.json", makeCompilationDatabase(commands, versionDirectory + "/vfsoverlay.yaml"));
 }
@@ -1,33 +1,91 @@
 #ifndef _SEMANTICUTIL
 #define _SEMANTICUTIL
 
+#include "SemanticCount.h"
+#include "SemanticPatch.h"
+
 #include "clang/AST/ASTContext.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include "json.h"
 
+#include <set>
 #include <string>
 #include <vector>
 
-// Method used to initialize the random seed.
-void init_random(unsigned seed);
+class OutputWriter;
+class VersionOutput;
+
+// Stream used for the messages of the tool. Worker threads collect their messages in a LogBuffer.
+llvm::raw_ostream& logs();
 
-// Method used to choose a number between 0 and n ([0, n]).
-unsigned random_0_to_n(const unsigned n);
+// While an instance of this class exists, the messages of the current thread are collected in a buffer.
+// The buffer is printed as a whole when the instance is destroyed, so messages of threads don't interleave.
+class LogBuffer {
+    private:
+        std::string buffer;
+        llvm::raw_string_ostream stream;
+        llvm::raw_ostream* previous;
 
-// Generate a random ordering
-const std::vector<unsigned> generate_random_ordering(unsigned nrOfElements);
+    public:
+        LogBuffer();
+        ~LogBuffer();
+};
 
 // General utility functions.
 std::string location2str(const clang::SourceRange& range, const clang::ASTContext& astContext);
 
+// Method used to get the absolute paths of all files loaded by a source manager, i.e. the files a
+// translation unit depends on.
+std::set<std::string> getDependencies(const clang::SourceManager& sm);
+
+// Method used to get the absolute path of the main file of a source manager. The name of the main file is
+// taken from the compile command, so it can be relative to the directory of the command, which is the
+// working directory while the translation unit is parsed.
+std::string getMainFilePath(const clang::SourceManager& sm);
+
+// Method used to check whether the compile commands of the translation units only use absolute paths (for the
+// directory, the file and the include paths). ClangTool changes the working directory of the process to that of
+// the compile command, so only such commands can be run by multiple threads at once. Otherwise, the reason
+// names the first relative path.
+bool usesAbsolutePaths(const clang::tooling::CompilationDatabase& compilations, const std::vector<std::string>& sourcePaths, std::string& reason);
+
 // Method used to calculate the factorial of some given number.
-unsigned long factorial(unsigned long n);
+VersionCount factorial(unsigned n);
+
+// Method used to calculate the entropy of M equiprobable choices. It is computed in the log domain, so it
+// stays exact for counts that don't fit in 64 bits.
+double entropyEquiprobable(const VersionCount& m);
 
-// Method used to calculate the entropy of M equiprobable choices.
-double entropyEquiprobable(long m);
+// Method used to get the path of a file relative to the base directory, i.e. its path within a version. The
+// path doesn't start with a separator.
+std::string getRelativePath(const std::string& fileName, const std::string& baseDirectory);
+
+// Method used to get the output directory of a given version.
+std::string getVersionDirectory(const std::string& outputPath, long version);
 
 // Method used to write JSON to a give file.
-void writeJSONToFile(std::string outputPath, int version, std::string fileName, Json::Value output);
+void writeJSONToFile(OutputWriter& writer, std::string outputPath, int version, std::string fileName, Json::Value output);
+
+// Method used to write the changes made by a rewriter to the output directory of a given version. The files
+// are handed to the output writer, which may write them in the background. When patches are collected,
+// only the diffs of the files are added to the patch of the version.
+void writeChangesToOutput(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, RecordingRewriter& rewriter);
+
+// Method used to write the contents of a file to the output directory of a given version.
+bool writeFileToOutput(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, const std::string& fileName, std::string contents);
+
+// Method used to add the diff of a file, derived from the edits made to it, to the patch of a given version.
+bool addPatchToOutput(VersionOutput& output, const std::string& baseDirectory, unsigned long version, const std::string& fileName, llvm::StringRef original, const std::vector<SourceEdit>& edits);
+
+// Method used to write the patch of a given version, once all its files have been added to it.
+void writePatchToOutput(VersionOutput& output, const std::string& outputPath, unsigned long version);
+
+// Method used to write the VFS overlay and the compilation database of a given version, once all its files
+// have been written. The overlay maps the files written for the version over the base directory.
+void writeOverlayToOutput(VersionOutput& output, const std::string& outputPath, const std::string& baseDirectory, unsigned long version, const std::vector<clang::tooling::CompileCommand>& commands);
 
 #endif
@@ -7,23 +7,43 @@
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Rewrite/Frontend/Rewriters.h"
 
+#include <map>
+#include <string>
+
 template <typename TargetType>
 class SemanticAnalyser {
     protected:
         clang::ASTContext& astContext; // Used for getting additional AST info.
         const MetaData& metadata;
         Candidates<TargetType>& candidates;
+        const std::string mainFile;// The absolute path of the main file of the translation unit being analysed
 
         SemanticAnalyser(clang::ASTContext& Context, const MetaData& metadata, Candidates<TargetType>& candidates)
-            : astContext(Context), metadata(metadata), candidates(candidates) { }
+            : astContext(Context), metadata(metadata), candidates(candidates), mainFile(getMainFilePath(Context.getSourceManager())) { }
+};
+
+template <typename TargetType>
+class SemanticLocator {
+    protected:
+        clang::ASTContext& astContext; // Used for getting additional AST info.
+        std::map<TargetType, typename TargetType::Nodes>& nodes;// The targets to look for, and the nodes found for them.
+
+        SemanticLocator(clang::ASTContext& Context, std::map<TargetType, typename TargetType::Nodes>& nodes)
+            : astContext(Context), nodes(nodes) { }
+
+        // Get the nodes of a target, or nullptr if we're not looking for the target.
+        typename TargetType::Nodes* lookup(const TargetType& target) {
+            auto it = nodes.find(target);
+            return (it != nodes.end()) ? &it->second : nullptr;
+        }
 };
 
 class SemanticRewriter {
     protected:
         clang::ASTContext& astContext; // Used for getting additional AST info.
-        clang::Rewriter& rewriter;
+        RecordingRewriter& rewriter;
 
-        explicit SemanticRewriter(clang::ASTContext& Context, clang::Rewriter& rewriter)
+        explicit SemanticRewriter(clang::ASTContext& Context, RecordingRewriter& rewriter)
             : astContext(Context), rewriter(rewriter)
         {
             rewriter.setSourceMgr(astContext.getSourceManager(), astContext.getLangOpts());
@@ -23,15 +23,33 @@ bool StructUnique::Analyser::VisitRecordDecl(clang::RecordDecl* D) {
             if (fileName.find(metadata.baseDirectory) == std::string::npos)
                 return true;
 
+            // Every translation unit containing the definition has to be rewritten.
+            candidates.addTranslationUnit(candidate, mainFile);
+
             // To be a valid candidate none of the fields can be macro.
             for(auto field : D->fields())
                 if (field->getLocStart().isMacroID())
                     return true;
 
+            // Record the fields of the definition, so versions can be generated by splicing.
+            const SourceManager& sm = astContext.getSourceManager();
+            SourceSite site("int XXX", ";\n", "\n;");
+            bool spliceable = true;
+            for(auto field : D->fields())
+            {
+                const SourceRange& range = field->getSourceRange();
+                const SourceRange rangeExpanded(sm.getExpansionRange(range.getBegin()).first, sm.getExpansionRange(range.getEnd()).second);
+                spliceable = spliceable && site.addSlice(rangeExpanded, location2str(rangeExpanded, astContext), astContext);
+            }
+            if (spliceable)
+                candidates.addSite(candidate, site);
+            else
+                candidates.setUnspliceable(candidate);
+
             StructUnique::Data& data = candidates.get(candidate);
             if (data.valid && data.empty())
             {
-                llvm::outs() << "Found valid candidate: " << candidate.getName() << "\n";
+                candidates.log() << "Found valid candidate: " << candidate.getName() << "\n";
                 data.addFields(D);
             }
         }
@@ -123,66 +141,91 @@ bool StructUnique::Analyser::VisitVarDecl(clang::VarDecl *D) {
     return true;
 }
 
+bool StructUnique::Locator::VisitRecordDecl(clang::RecordDecl* D) {
+    // We make sure the record is a struct and a definition.
+    if (D->isStruct() && D->isThisDeclarationADefinition()) {
+        if (StructUnique::Nodes* found = lookup(StructUnique(D, astContext)))
+            found->records.push_back(D);
+    }
+    return true;
+}
+
 bool StructReorderingRewriter::VisitRecordDecl(clang::RecordDecl* D) {
     // We make sure the record is a struct and a definition.
     if (D->isStruct() && D->isThisDeclarationADefinition()) {
         // Check if this is a declaration for the struct that is to be reordered
         const StructUnique target(D, astContext);
-        if (transformation.target == target) {
-            llvm::outs() << "Declaration of: " << target.getName() << " has to be rewritten!\n";
-
-            auto ordering = transformation.ordering;
-            std::vector<clang::FieldDecl*> fields(D->field_begin(), D->field_end());
-            for (size_t iii = 0; iii < fields.size(); iii++) {
-                const SourceRange& oldRange = fields[iii]->getSourceRange();
-                const SourceRange& newRange = fields[ordering[iii]]->getSourceRange();
-                const SourceRange oldRangeExpanded(astContext.getSourceManager().getExpansionRange(oldRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(oldRange.getEnd()).second);
-                const SourceRange newRangeExpanded(astContext.getSourceManager().getExpansionRange(newRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(newRange.getEnd()).second);
-
-                // We replace the field with another one based on the ordering.
-                const std::string substitute = location2str(newRangeExpanded, astContext);
-                rewriter.ReplaceText(oldRangeExpanded, substitute);
-            }
-        }
+        if (transformation.target == target)
+            rewriteRecordDecl(D);
     }
     return true;
 }
 
+void StructReorderingRewriter::rewriteRecordDecl(clang::RecordDecl* D) {
+    logs() << "Declaration of: " << transformation.target.getName() << " has to be rewritten!\n";
+
+    auto ordering = transformation.ordering;
+    std::vector<clang::FieldDecl*> fields(D->field_begin(), D->field_end());
+    for (size_t iii = 0; iii < fields.size(); iii++) {
+        const SourceRange& oldRange = fields[iii]->getSourceRange();
+        const SourceRange& newRange = fields[ordering[iii]]->getSourceRange();
+        const SourceRange oldRangeExpanded(astContext.getSourceManager().getExpansionRange(oldRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(oldRange.getEnd()).second);
+        const SourceRange newRangeExpanded(astContext.getSourceManager().getExpansionRange(newRange.getBegin()).first, astContext.getSourceManager().getExpansionRange(newRange.getEnd()).second);
+
+        // We replace the field with another one based on the ordering.
+        const std::string substitute = location2str(newRangeExpanded, astContext);
+        rewriter.ReplaceText(oldRangeExpanded, substitute);
+    }
+}
+
+void StructReorderingRewriter::rewriteNodes(const StructUnique::Nodes& nodes) {
+    for (auto D : nodes.records)
+        rewriteRecordDecl(D);
+}
+
 bool StructInsertionRewriter::VisitRecordDecl(clang::RecordDecl* D) {
     // We make sure the record is a struct and a definition.
     if (D->isStruct() && D->isThisDeclarationADefinition()) {
         // Check if this is a declaration for the struct that is to be reordered
         const StructUnique target(D, astContext);
-        if (transformation.target == target) {
-            llvm::outs() << "Declaration of: " << target.getName() << " has to be rewritten!\n";
+        if (transformation.target == target)
+            rewriteRecordDecl(D);
+    }
+    return true;
+}
 
-            std::vector<clang::FieldDecl*> fields(D->field_begin(), D->field_end());
-            const FieldDecl* field;
-            bool before;
-            if (transformation.insertionPoint < fields.size())
-            {
-                field = fields[transformation.insertionPoint];
-                before = true;
-            }
-            else
-            {
-                field = fields[fields.size() -1];
-                before = false;
-            }
+void StructInsertionRewriter::rewriteRecordDecl(clang::RecordDecl* D) {
+    logs() << "Declaration of: " << transformation.target.getName() << " has to be rewritten!\n";
+
+    std::vector<clang::FieldDecl*> fields(D->field_begin(), D->field_end());
+    const FieldDecl* field;
+    bool before;
+    if (transformation.insertionPoint < fields.size())
+    {
+        field = fields[transformation.insertionPoint];
+        before = true;
+    }
+    else
+    {
+        field = fields[fields.size() -1];
+        before = false;
+    }
 
-            const SourceRange& range = field->getSourceRange();
-            const SourceRange rangeExpanded(astContext.getSourceManager().getExpansionRange(range.getBegin()).first, astContext.getSourceManager().getExpansionRange(range.getEnd()).second);
-            std::string substitute = location2str(rangeExpanded, astContext);
+    const SourceRange& range = field->getSourceRange();
+    const SourceRange rangeExpanded(astContext.getSourceManager().getExpansionRange(range.getBegin()).first, astContext.getSourceManager().getExpansionRange(range.getEnd()).second);
+    std::string substitute = location2str(rangeExpanded, astContext);
 
-            std::string newField = "int XXX";
+    std::string newField = "int XXX";
 
-            if (before)
-                substitute =  newField + ";\n" + substitute;
-            else
-                substitute = substitute + "\n;" + newField;
+    if (before)
+        substitute =  newField + ";\n" + substitute;
+    else
+        substitute = substitute + "\n;" + newField;
 
-            rewriter.ReplaceText(rangeExpanded, substitute);
-        }
-    }
-    return true;
+    rewriter.ReplaceText(rangeExpanded, substitute);
+}
+
+void StructInsertionRewriter::rewriteNodes(const StructUnique::Nodes& nodes) {
+    for (auto D : nodes.records)
+        rewriteRecordDecl(D);
 }
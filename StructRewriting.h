@@ -8,6 +8,7 @@
 #include "clang/AST/Decl.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,12 @@ class StructUnique : public TargetUnique {
             }
         }
 
+        StructUnique(const std::string& name, const std::string& fileName, bool global = false)
+            : TargetUnique(name, fileName, global) {}
+
+        // The kind of targets, which identifies their candidate database.
+        static const char* getKind() { return "struct"; }
+
         class Data : public TargetUnique::Data {
             struct StructField {
                 std::string name;
@@ -43,6 +50,13 @@ class StructUnique : public TargetUnique {
                     fields.emplace_back(field->getNameAsString(), field->getType().getAsString());
                 }
             }
+            void merge(const TargetUnique::Data& other) {
+                // Like during analysis, the items are only taken if we don't know them yet
+                const Data& data = static_cast<const Data&>(other);
+                if (valid && fields.empty())
+                    fields = data.fields;
+                TargetUnique::Data::merge(other);
+            }
             bool empty() const {
                 return fields.empty();
             }
@@ -61,6 +75,22 @@ class StructUnique : public TargetUnique {
             unsigned nrOfItems() const {
                 return fields.size();
             }
+            void serialize(BinaryWriter& writer) const {
+                TargetUnique::Data::serialize(writer);
+                writer.writeU32(fields.size());
+                for (const auto& field : fields) {
+                    writer.writeString(field.name);
+                    writer.writeString(field.type);
+                }
+            }
+            void deserialize(BinaryReader& reader) {
+                TargetUnique::Data::deserialize(reader);
+                const uint32_t nrOfFields = reader.readU32();
+                for (uint32_t iii = 0; iii < nrOfFields && reader.ok(); iii++) {
+                    const std::string name = reader.readString();
+                    fields.emplace_back(name, reader.readString());
+                }
+            }
         };
 
 
@@ -75,6 +105,20 @@ class StructUnique : public TargetUnique {
                 bool VisitRecordDecl(clang::RecordDecl* D);
                 bool VisitVarDecl(clang::VarDecl* D);
         };
+
+        // The nodes of a translation unit that have to be rewritten for a target.
+        struct Nodes {
+            std::vector<clang::RecordDecl*> records;
+        };
+
+        // Semantic locator, will look up the nodes for a set of targets in a single traversal.
+        class Locator : public SemanticLocator<StructUnique>, public clang::RecursiveASTVisitor<Locator> {
+            public:
+                explicit Locator(clang::ASTContext& Context, std::map<StructUnique, Nodes>& nodes)
+                    : SemanticLocator(Context, nodes) {}
+
+                bool VisitRecordDecl(clang::RecordDecl* D);
+        };
 };
 
 // Semantic Rewriter, will rewrite source code based on the AST.
@@ -82,12 +126,16 @@ class StructReorderingRewriter : public SemanticRewriter, public clang::Recursiv
     private:
         const ReorderingTransformation& transformation;
     public:
-        explicit StructReorderingRewriter(clang::ASTContext& Context, const Transformation& transformation, clang::Rewriter& rewriter)
+        explicit StructReorderingRewriter(clang::ASTContext& Context, const Transformation& transformation, RecordingRewriter& rewriter)
             : SemanticRewriter(Context, rewriter), transformation(static_cast<const ReorderingTransformation&>(transformation)) {}
 
         // We want to investigate top-level things.
         bool VisitRecordDecl(clang::RecordDecl* D);
 
+        // Rewrite nodes that are known to belong to the target.
+        void rewriteRecordDecl(clang::RecordDecl* D);
+        void rewriteNodes(const StructUnique::Nodes& nodes);
+
         typedef StructUnique Target;
         typedef ReorderingTransformation TransformationType;
 };
@@ -97,12 +145,16 @@ class StructInsertionRewriter : public SemanticRewriter, public clang::Recursive
     private:
         const InsertionTransformation& transformation;
     public:
-        explicit StructInsertionRewriter(clang::ASTContext& Context, const Transformation& transformation, clang::Rewriter& rewriter)
+        explicit StructInsertionRewriter(clang::ASTContext& Context, const Transformation& transformation, RecordingRewriter& rewriter)
             : SemanticRewriter(Context, rewriter), transformation(static_cast<const InsertionTransformation&>(transformation)) {}
 
         // We want to investigate top-level things.
         bool VisitRecordDecl(clang::RecordDecl* D);
 
+        // Rewrite nodes that are known to belong to the target.
+        void rewriteRecordDecl(clang::RecordDecl* D);
+        void rewriteNodes(const StructUnique::Nodes& nodes);
+
         typedef StructUnique Target;
         typedef InsertionTransformation TransformationType;
 };